@@ -0,0 +1,124 @@
+/*
+ * Copyright © 2019 Paweł Dziepak
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <chrono>
+
+#include <benchmark/benchmark.h>
+
+#include "codegen/codegen.hpp"
+
+namespace cg = codegen;
+
+// builds a module with many functions and calls only one of them.
+static void time_to_first_call(benchmark::State& state) {
+  auto comp = codegen::compiler_context("codegen", cg::compiler_options{.lazy = state.range(0) != 0});
+  auto const function_count = state.range(1);
+
+  for (auto _ : state) {
+    auto builder = codegen::module_builder(comp, "time_to_first_call");
+    auto functions = std::vector<cg::function_ref<int32_t, int32_t>>{};
+    for (auto i = 0; i < function_count; i++) {
+      functions.emplace_back(
+          builder.create_function<int32_t(int32_t)>("fn" + std::to_string(i), [&](cg::value<int32_t> x) {
+            auto total = cg::variable<int32_t>("total", x);
+            cg::while_([&] { return total.get() < cg::constant<int32_t>(i); },
+                       [&] { total.set(total.get() * cg::constant<int32_t>(3) + cg::constant<int32_t>(1)); });
+            cg::return_(total.get());
+          }));
+    }
+    auto module = std::move(builder).build();
+    benchmark::DoNotOptimize(module.get_address(functions[0])(1));
+  }
+}
+
+BENCHMARK(time_to_first_call)->ArgsProduct({{0, 1}, {16, 256}})->ArgNames({"lazy", "functions"});
+
+// builds and compiles a module with and without debug info and pseudo-c source generation.
+static void build_latency(benchmark::State& state) {
+  auto const debug = state.range(0) != 0;
+  auto comp = codegen::compiler_context("codegen", cg::compiler_options{.debug_info = debug});
+  auto const function_count = state.range(1);
+
+  for (auto _ : state) {
+    auto builder = codegen::module_builder(comp, "build_latency", debug);
+    auto functions = std::vector<cg::function_ref<int32_t, int32_t*, int32_t>>{};
+    for (auto i = 0; i < function_count; i++) {
+      functions.emplace_back(builder.create_function<int32_t(int32_t*, int32_t)>(
+          "fn" + std::to_string(i), [&](cg::value<int32_t*> ptr, cg::value<int32_t> n) {
+            auto total = cg::variable<int32_t>("total", cg::constant<int32_t>(i));
+            auto idx = cg::variable<int32_t>("idx", cg::constant<int32_t>(0));
+            cg::while_([&] { return idx.get() < n; },
+                       [&] {
+                         total.set(total.get() + cg::load(ptr + idx.get()));
+                         idx.set(idx.get() + cg::constant<int32_t>(1));
+                       });
+            cg::return_(total.get());
+          }));
+    }
+    auto module = std::move(builder).build();
+    benchmark::DoNotOptimize(module.get_address(functions[0]));
+  }
+}
+
+BENCHMARK(build_latency)->ArgsProduct({{0, 1}, {16, 256}})->ArgNames({"debug", "functions"});
+
+namespace {
+int32_t external_increment(int32_t x) {
+  return x + 1;
+}
+} // namespace
+
+// links a module calling many external functions, with and without the symbols of the process visible to it.
+static void link_external_calls(benchmark::State& state) {
+  auto comp = codegen::compiler_context("codegen", cg::compiler_options{.process_symbols = state.range(0) != 0});
+  auto const call_count = state.range(1);
+
+  auto linking = std::chrono::nanoseconds{0};
+  for (auto _ : state) {
+    auto builder = codegen::module_builder(comp, "link_external_calls");
+    auto externals = std::vector<cg::function_ref<int32_t, int32_t>>{};
+    for (auto i = 0; i < call_count; i++) {
+      externals.emplace_back(
+          builder.declare_external_function("external" + std::to_string(i), &external_increment));
+    }
+    auto caller = builder.create_function<int32_t(int32_t)>("caller", [&](cg::value<int32_t> x) {
+      auto total = cg::variable<int32_t>("total", x);
+      for (auto& fn : externals) { total.set(cg::call(fn, total.get())); }
+      cg::return_(total.get());
+    });
+    auto module = std::move(builder).build();
+    benchmark::DoNotOptimize(module.get_address(caller)(0));
+    linking += module.report().linking;
+  }
+  auto linking_us = std::chrono::duration<double, std::micro>(linking).count();
+  state.counters["linking_us"] = benchmark::Counter(linking_us, benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK(link_external_calls)->ArgsProduct({{0, 1}, {16, 256}})->ArgNames({"process_symbols", "calls"});
+
+int main(int argc, char** argv) {
+  INIT_LLVM_ENV(argc, argv);
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) { return 1; }
+  ::benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
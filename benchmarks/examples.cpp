@@ -0,0 +1,247 @@
+/*
+ * Copyright © 2019 Paweł Dziepak
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <numeric>
+#include <random>
+
+#include <benchmark/benchmark.h>
+
+#include "codegen/codegen.hpp"
+
+#include "runtime.hpp"
+
+namespace cg = codegen;
+using namespace cg::literals;
+
+static void soa_compute(benchmark::State& state) {
+  auto comp = codegen::compiler_context("codegen", static_cast<cg::optimization_level>(state.range(0)));
+  auto builder = codegen::module_builder(comp, "soa_compute");
+  auto compute = builder.create_function<void(int32_t, int32_t const*, int32_t const*, int32_t*, uint64_t)>(
+      "compute", [&](cg::value<int32_t> a, cg::value<int32_t const*> b_ptr, cg::value<int32_t const*> c_ptr,
+                     cg::value<int32_t*> d_ptr, cg::value<uint64_t> n) {
+        auto idx = cg::variable<uint64_t>("idx", 0_u64);
+        cg::while_([&] { return idx.get() < n; },
+                   [&] {
+                     auto i = idx.get();
+                     cg::store(a * cg::load(b_ptr + i) + cg::load(c_ptr + i), d_ptr + i);
+                     idx.set(i + 1_u64);
+                   });
+        cg::return_();
+      });
+  auto module = std::move(builder).build();
+  auto compute_ptr = module.get_address(compute);
+
+  auto gen = std::default_random_engine{};
+  auto dist = std::uniform_int_distribution<int32_t>(-10000, 10000);
+
+  auto const n = state.range(1);
+  auto b = std::vector<int32_t>();
+  auto c = std::vector<int32_t>();
+  auto d = std::vector<int32_t>(n);
+  std::generate_n(std::back_inserter(b), n, [&] { return dist(gen); });
+  std::generate_n(std::back_inserter(c), n, [&] { return dist(gen); });
+
+  for (auto _ : state) {
+    compute_ptr(7, b.data(), c.data(), d.data(), n);
+    benchmark::DoNotOptimize(d.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// soa_compute with a counted loop and vectorization hints instead of while_().
+static void soa_compute_for(benchmark::State& state) {
+  auto comp = codegen::compiler_context("codegen", static_cast<cg::optimization_level>(state.range(0)));
+  auto builder = codegen::module_builder(comp, "soa_compute_for");
+  auto compute = builder.create_function<void(int32_t, int32_t const*, int32_t const*, int32_t*, uint64_t)>(
+      "compute", [&](cg::value<int32_t> a, cg::value<int32_t const*> b_ptr, cg::value<int32_t const*> c_ptr,
+                     cg::value<int32_t*> d_ptr, cg::value<uint64_t> n) {
+        cg::for_(
+            0_u64, n, 1_u64,
+            [&](cg::value<uint64_t> i) { cg::store(a * cg::load(b_ptr + i) + cg::load(c_ptr + i), d_ptr + i); },
+            cg::loop_hints{.vectorize = true, .interleave_count = 4});
+        cg::return_();
+      });
+  auto module = std::move(builder).build();
+  auto compute_ptr = module.get_address(compute);
+
+  auto gen = std::default_random_engine{};
+  auto dist = std::uniform_int_distribution<int32_t>(-10000, 10000);
+
+  auto const n = state.range(1);
+  auto b = std::vector<int32_t>();
+  auto c = std::vector<int32_t>();
+  auto d = std::vector<int32_t>(n);
+  std::generate_n(std::back_inserter(b), n, [&] { return dist(gen); });
+  std::generate_n(std::back_inserter(c), n, [&] { return dist(gen); });
+
+  for (auto _ : state) {
+    compute_ptr(7, b.data(), c.data(), d.data(), n);
+    benchmark::DoNotOptimize(d.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+static void trivial_while(benchmark::State& state) {
+  auto comp = codegen::compiler_context("codegen", static_cast<cg::optimization_level>(state.range(0)));
+  auto builder = codegen::module_builder(comp, "trivial_while");
+  auto count = builder.create_function<unsigned(unsigned)>("count", [](cg::value<unsigned> target) {
+    auto var = cg::variable<unsigned>("var", cg::constant<unsigned>(0));
+    cg::while_([&] { return var.get() < target; }, [&] { var.set(var.get() + cg::constant<unsigned>(1)); });
+    cg::return_(var.get());
+  });
+  auto module = std::move(builder).build();
+  auto count_ptr = module.get_address(count);
+
+  auto const n = static_cast<unsigned>(state.range(1));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(n);
+    benchmark::DoNotOptimize(count_ptr(n));
+  }
+}
+
+// hashes an array with a helper function, called through a pointer to the host function or inlined from the runtime
+// bitcode.
+static void runtime_calls(benchmark::State& state) {
+  auto comp = codegen::compiler_context("codegen", cg::optimization_level::O3);
+  if (state.range(0)) { comp.add_runtime_library(CODEGEN_RUNTIME_BITCODE); }
+  auto builder = codegen::module_builder(comp, "runtime_calls");
+  auto hash = builder.declare_external_function("runtime_hash", &runtime_hash);
+  auto hash_all = builder.create_function<uint64_t(uint64_t const*, uint64_t)>(
+      "hash_all", [&](cg::value<uint64_t const*> ptr, cg::value<uint64_t> n) {
+        auto total = cg::variable<uint64_t>("total", 0_u64);
+        auto idx = cg::variable<uint64_t>("idx", 0_u64);
+        cg::while_([&] { return idx.get() < n; },
+                   [&] {
+                     total.set(total.get() ^ cg::call(hash, cg::load(ptr + idx.get())));
+                     idx.set(idx.get() + 1_u64);
+                   });
+        cg::return_(total.get());
+      });
+  auto module = std::move(builder).build();
+  auto hash_all_ptr = module.get_address(hash_all);
+
+  auto const n = state.range(1);
+  auto values = std::vector<uint64_t>(n);
+  std::iota(values.begin(), values.end(), 0);
+  for (auto _ : state) { benchmark::DoNotOptimize(hash_all_ptr(values.data(), n)); }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// selects the values greater than a threshold into a dense output, without a branch per value.
+static void filter_compress(benchmark::State& state) {
+  auto comp = codegen::compiler_context("codegen", cg::optimization_level::O3);
+  auto builder = codegen::module_builder(comp, "filter_compress");
+  auto filter = builder.create_function<uint64_t(int32_t const*, int32_t, int32_t*, uint64_t)>(
+      "filter", [&](cg::value<int32_t const*> in, cg::value<int32_t> threshold, cg::value<int32_t*> out,
+                    cg::value<uint64_t> n) {
+        auto selected = cg::variable<uint64_t>("selected", 0_u64);
+        cg::for_(0_u64, n, 8_u64, [&](cg::value<uint64_t> i) {
+          auto v = cg::load<8>(in + i);
+          auto count = cg::builtin::compress_store(v, out + selected.get(), v > cg::splat<8>(threshold));
+          selected.set(selected.get() + cg::cast<uint64_t>(count));
+        });
+        cg::return_(selected.get());
+      });
+  auto module = std::move(builder).build();
+  auto filter_ptr = module.get_address(filter);
+
+  auto gen = std::default_random_engine{};
+  auto dist = std::uniform_int_distribution<int32_t>(-10000, 10000);
+
+  auto const n = state.range(0);
+  auto in = std::vector<int32_t>();
+  auto out = std::vector<int32_t>(n);
+  std::generate_n(std::back_inserter(in), n, [&] { return dist(gen); });
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(filter_ptr(in.data(), 0, out.data(), n));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+// selects the values greater than a threshold of random data, either with a branch per value or predicated with
+// select_().
+static void filter_predicated(benchmark::State& state) {
+  auto comp = codegen::compiler_context("codegen", cg::optimization_level::O3);
+  auto builder = codegen::module_builder(comp, "filter_predicated");
+  auto const predicated = state.range(0) != 0;
+  auto filter = builder.create_function<uint64_t(int32_t const*, int32_t, int32_t*, uint64_t)>(
+      "filter", [&](cg::value<int32_t const*> in, cg::value<int32_t> threshold, cg::value<int32_t*> out,
+                    cg::value<uint64_t> n) {
+        auto selected = cg::variable<uint64_t>("selected", 0_u64);
+        cg::for_(0_u64, n, 1_u64, [&](cg::value<uint64_t> i) {
+          auto v = cg::load(in + i);
+          if (predicated) {
+            cg::store(v, out + selected.get());
+            selected.set(selected.get() + cg::select_(v > threshold, 1_u64, 0_u64));
+          } else {
+            cg::if_(v > threshold, [&] {
+              cg::store(v, out + selected.get());
+              selected.set(selected.get() + 1_u64);
+            });
+          }
+        });
+        cg::return_(selected.get());
+      });
+  auto module = std::move(builder).build();
+  auto filter_ptr = module.get_address(filter);
+
+  auto gen = std::default_random_engine{};
+  auto dist = std::uniform_int_distribution<int32_t>(-10000, 10000);
+
+  auto const n = state.range(1);
+  auto in = std::vector<int32_t>();
+  auto out = std::vector<int32_t>(n);
+  std::generate_n(std::back_inserter(in), n, [&] { return dist(gen); });
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(filter_ptr(in.data(), 0, out.data(), n));
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+static void optimization_levels(benchmark::internal::Benchmark* b) {
+  for (auto level : {cg::optimization_level::O0, cg::optimization_level::O1, cg::optimization_level::O2,
+                     cg::optimization_level::O3, cg::optimization_level::Os}) {
+    b->Args({static_cast<int64_t>(level), 1 << 20});
+  }
+  b->ArgNames({"level", "n"});
+}
+
+BENCHMARK(soa_compute)->Apply(optimization_levels);
+BENCHMARK(soa_compute_for)->Apply(optimization_levels);
+BENCHMARK(trivial_while)->Apply(optimization_levels);
+BENCHMARK(runtime_calls)->ArgsProduct({{0, 1}, {1 << 20}})->ArgNames({"inline", "n"});
+BENCHMARK(filter_compress)->Arg(1 << 20);
+BENCHMARK(filter_predicated)->ArgsProduct({{0, 1}, {1 << 20}})->ArgNames({"predicated", "n"});
+
+int main(int argc, char** argv) {
+  INIT_LLVM_ENV(argc, argv);
+  ::benchmark::Initialize(&argc, argv);
+  if (::benchmark::ReportUnrecognizedArguments(argc, argv)) { return 1; }
+  ::benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// helpers called by the generated code, both compiled into the benchmark and linked into its modules as bitcode.
+extern "C" uint64_t runtime_hash(uint64_t x);
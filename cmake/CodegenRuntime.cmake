@@ -0,0 +1,54 @@
+# compiles C++ sources of runtime helpers to a single bitcode file, to be added to a compiler_context with
+# compiler_context::add_runtime_library().
+#
+#   codegen_add_runtime_bitcode(<target> SOURCES <source>... [OUTPUT <file>] [COMPILE_OPTIONS <option>...])
+#
+# creates the custom target <target> building <file>, ${CMAKE_CURRENT_BINARY_DIR}/<target>.bc by default, and stores
+# its path in the CODEGEN_RUNTIME_BITCODE property of the target. the sources are compiled with the clang of the LLVM
+# codegen is built against, older readers cannot parse bitcode from newer compilers.
+
+find_program(CODEGEN_CLANGXX
+  NAMES clang++-${LLVM_VERSION_MAJOR} clang++
+  HINTS ${LLVM_TOOLS_BINARY_DIR}
+)
+find_program(CODEGEN_LLVM_LINK
+  NAMES llvm-link-${LLVM_VERSION_MAJOR} llvm-link
+  HINTS ${LLVM_TOOLS_BINARY_DIR}
+)
+
+function(codegen_add_runtime_bitcode TARGET)
+  cmake_parse_arguments(RUNTIME "" "OUTPUT" "SOURCES;COMPILE_OPTIONS" ${ARGN})
+  if(NOT CODEGEN_CLANGXX OR NOT CODEGEN_LLVM_LINK)
+    message(FATAL_ERROR "codegen_add_runtime_bitcode() requires clang++ and llvm-link ${LLVM_VERSION_MAJOR}")
+  endif()
+  if(NOT RUNTIME_OUTPUT)
+    set(RUNTIME_OUTPUT ${CMAKE_CURRENT_BINARY_DIR}/${TARGET}.bc)
+  endif()
+
+  set(objects)
+  foreach(source ${RUNTIME_SOURCES})
+    get_filename_component(source ${source} ABSOLUTE)
+    get_filename_component(name ${source} NAME_WE)
+    set(object ${CMAKE_CURRENT_BINARY_DIR}/${TARGET}.dir/${name}.bc)
+    # -fPIC keeps calls from the helpers to the host out of reach of 32-bit relocations, the jitted code may be mapped
+    # far away from it.
+    add_custom_command(
+      OUTPUT ${object}
+      COMMAND ${CODEGEN_CLANGXX} -std=c++20 -O2 -fPIC -emit-llvm -c ${RUNTIME_COMPILE_OPTIONS} ${source} -o ${object}
+      DEPENDS ${source}
+      COMMENT "Compiling runtime bitcode ${name}.bc"
+      VERBATIM
+    )
+    list(APPEND objects ${object})
+  endforeach()
+
+  add_custom_command(
+    OUTPUT ${RUNTIME_OUTPUT}
+    COMMAND ${CODEGEN_LLVM_LINK} ${objects} -o ${RUNTIME_OUTPUT}
+    DEPENDS ${objects}
+    COMMENT "Linking runtime bitcode ${TARGET}"
+    VERBATIM
+  )
+  add_custom_target(${TARGET} DEPENDS ${RUNTIME_OUTPUT})
+  set_target_properties(${TARGET} PROPERTIES CODEGEN_RUNTIME_BITCODE ${RUNTIME_OUTPUT})
+endfunction(codegen_add_runtime_bitcode)
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Object/ArchiveWriter.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+
+#include <fmt/format.h>
+
+#include "optimizer.hpp"
+#include "utils.hpp"
+
+namespace codegen {
+
+// target of an ahead-of-time compiled module. targets other than the native one have to be initialized by the
+// application, e.g. with llvm::InitializeAllTargets().
+struct aot_options {
+  std::string triple = llvm::sys::getProcessTriple();
+  std::string cpu = llvm::sys::getHostCPUName().str();
+  std::string features;
+  // defaults to the optimization level of the module_builder, or its compiler_context.
+  std::optional<optimization_level> level;
+  // if set, a C++ header declaring all functions of the module is written there.
+  std::optional<std::filesystem::path> header;
+};
+
+namespace detail {
+
+// c++ signature of a function defined by a module_builder.
+struct function_signature {
+  std::string name;
+  std::string return_type;
+  // declarations of the parameters, e.g. int32_t (*arg0)[4].
+  std::vector<std::string> arguments;
+  // false if the return type or a parameter has no usable c++ declaration, e.g. a struct passed by value, which is
+  // opaque in headers, or a mask vector.
+  bool declarable = true;
+};
+
+inline std::string cxx_declaration(function_signature const& sig) {
+  auto arguments = std::string{};
+  for (auto i = 0u; i < sig.arguments.size(); i++) {
+    arguments += fmt::format("{}{}", i ? ", " : "", sig.arguments[i]);
+  }
+  return fmt::format("{} {}({});", sig.return_type, sig.name, arguments);
+}
+
+inline void write_header(std::filesystem::path const& path, std::string const& module_name,
+                         std::vector<function_signature> const& signatures) {
+  for (auto& sig : signatures) {
+    if (!sig.declarable) {
+      throw llvm_error(llvm::createStringError(llvm::inconvertibleErrorCode(), "%s cannot be declared in a c++ header",
+                                               cxx_declaration(sig).c_str()));
+    }
+  }
+  auto ofs = std::ofstream(path, std::ios::trunc);
+  ofs << fmt::format("// generated by codegen from module {}, do not edit.\n\n", module_name);
+  ofs << "#pragma once\n\n#include <cstddef>\n#include <cstdint>\n\nextern \"C\" {\n\n";
+  for (auto& sig : signatures) { ofs << cxx_declaration(sig) << "\n"; }
+  ofs << "\n}\n";
+  if (!ofs) {
+    throw llvm_error(llvm::createStringError(llvm::inconvertibleErrorCode(), "failed to write %s", path.c_str()));
+  }
+}
+
+// optimizes the module and compiles it to a relocatable object file for the given target.
+inline llvm::SmallVector<char, 0> compile_object(llvm::Module& module, aot_options const& options,
+                                                 optimization_level level) {
+  auto error = std::string{};
+  auto target = llvm::TargetRegistry::lookupTarget(options.triple, error);
+  if (!target) { throw llvm_error(llvm::createStringError(llvm::inconvertibleErrorCode(), error)); }
+  auto tm = std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+      options.triple, options.cpu, options.features, llvm::TargetOptions{}, llvm::Reloc::PIC_, llvm::None,
+      get_codegen_level(level)));
+
+  module.setTargetTriple(options.triple);
+  module.setDataLayout(tm->createDataLayout());
+  for (auto& fn : module) {
+    if (fn.isDeclaration()) { continue; }
+    fn.addFnAttr("target-cpu", options.cpu);
+    // the module builder sets the features of the host, they must not leak into code for another cpu.
+    if (options.features.empty()) {
+      fn.removeFnAttr("target-features");
+    } else {
+      fn.addFnAttr("target-features", options.features);
+    }
+  }
+  optimize_module(module, level, *tm);
+
+  auto object = llvm::SmallVector<char, 0>{};
+  auto os = llvm::raw_svector_ostream(object);
+  auto pm = llvm::legacy::PassManager{};
+  if (tm->addPassesToEmitFile(pm, os, nullptr, llvm::CGFT_ObjectFile)) {
+    throw llvm_error(llvm::createStringError(llvm::inconvertibleErrorCode(), "target %s cannot emit object files",
+                                             options.triple.c_str()));
+  }
+  pm.run(module);
+  return object;
+}
+
+inline void write_object(std::filesystem::path const& path, llvm::SmallVector<char, 0> const& object) {
+  auto ofs = std::ofstream(path, std::ios::binary | std::ios::trunc);
+  ofs.write(object.data(), object.size());
+  if (!ofs) {
+    throw llvm_error(llvm::createStringError(llvm::inconvertibleErrorCode(), "failed to write %s", path.c_str()));
+  }
+}
+
+inline void write_archive(std::filesystem::path const& path, std::string const& member_name,
+                          llvm::SmallVector<char, 0> const& object) {
+  auto member = llvm::NewArchiveMember(
+      llvm::MemoryBufferRef(llvm::StringRef(object.data(), object.size()), member_name));
+  throw_on_error(llvm::writeArchive(path.string(), {member}, true, llvm::object::Archive::K_GNU, true, false));
+}
+
+} // namespace detail
+
+} // namespace codegen
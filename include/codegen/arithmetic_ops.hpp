@@ -49,10 +49,14 @@ template<arithmetic_operation_type Op, LLVMTypeWrapper LHS, LLVMTypeWrapper RHS>
 public:
   using value_type = typename LHS::value_type;
 
+private:
+  using element_type = element_type_t<value_type>;
+
+public:
   arithmetic_operation(LHS lhs, RHS rhs) : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {}
 
   llvm::Value* eval() const {
-    if constexpr (std::is_integral_v<value_type>) {
+    if constexpr (std::is_integral_v<element_type>) {
       switch (Op) {
       case arithmetic_operation_type::add:
         return codegen::module_builder::current_builder()->ir_builder().CreateAdd(lhs_.eval(), rhs_.eval());
@@ -61,13 +65,13 @@ public:
       case arithmetic_operation_type::mul:
         return codegen::module_builder::current_builder()->ir_builder().CreateMul(lhs_.eval(), rhs_.eval());
       case arithmetic_operation_type::div:
-        if constexpr (std::is_signed_v<value_type>) {
+        if constexpr (std::is_signed_v<element_type>) {
           return codegen::module_builder::current_builder()->ir_builder().CreateSDiv(lhs_.eval(), rhs_.eval());
         } else {
           return codegen::module_builder::current_builder()->ir_builder().CreateUDiv(lhs_.eval(), rhs_.eval());
         }
       case arithmetic_operation_type::mod:
-        if constexpr (std::is_signed_v<value_type>) {
+        if constexpr (std::is_signed_v<element_type>) {
           return codegen::module_builder::current_builder()->ir_builder().CreateSRem(lhs_.eval(), rhs_.eval());
         } else {
           return codegen::module_builder::current_builder()->ir_builder().CreateURem(lhs_.eval(), rhs_.eval());
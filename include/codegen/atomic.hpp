@@ -0,0 +1,229 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/Support/AtomicOrdering.h>
+
+#include <fmt/format.h>
+
+#include "module_builder.hpp"
+#include "types.hpp"
+
+namespace codegen {
+
+enum class atomic_op {
+  xchg,
+  add,
+  sub,
+  and_,
+  or_,
+  xor_,
+  min,
+  max,
+};
+
+template<typename T> struct cmpxchg_result {
+  // the value that was in memory, equal to the expected one if the exchange succeeded.
+  value<T> old;
+  value<bool> success;
+};
+
+namespace detail {
+
+template<typename T>
+concept AtomicType = LLVMFloatingType<T> || LLVMPointerType<T> || (LLVMIntegralType<T> && !LLVMBoolType<T>);
+
+template<typename Ptr>
+concept AtomicPointer = Pointer<Ptr>&& AtomicType<std::remove_cv_t<std::remove_pointer_t<typename Ptr::value_type>>>;
+
+template<typename Ptr>
+concept MutableAtomicPointer =
+    AtomicPointer<Ptr> && (!std::is_const_v<std::remove_pointer_t<typename Ptr::value_type>>);
+
+template<typename Ptr, typename Value>
+concept AtomicOperands = MutableAtomicPointer<Ptr> && LLVMTypeWrapper<Value> &&
+                         std::same_as<std::remove_pointer_t<typename Ptr::value_type>, typename Value::value_type>;
+
+// memory_order_consume is treated as acquire, as compilers do.
+inline llvm::AtomicOrdering get_atomic_ordering(std::memory_order order) {
+  switch (order) {
+  case std::memory_order_relaxed: return llvm::AtomicOrdering::Monotonic;
+  case std::memory_order_consume: [[fallthrough]];
+  case std::memory_order_acquire: return llvm::AtomicOrdering::Acquire;
+  case std::memory_order_release: return llvm::AtomicOrdering::Release;
+  case std::memory_order_acq_rel: return llvm::AtomicOrdering::AcquireRelease;
+  case std::memory_order_seq_cst: return llvm::AtomicOrdering::SequentiallyConsistent;
+  }
+  llvm_unreachable("unknown memory order");
+}
+
+inline char const* memory_order_name(std::memory_order order) {
+  switch (order) {
+  case std::memory_order_relaxed: return "relaxed";
+  case std::memory_order_consume: return "consume";
+  case std::memory_order_acquire: return "acquire";
+  case std::memory_order_release: return "release";
+  case std::memory_order_acq_rel: return "acq_rel";
+  case std::memory_order_seq_cst: return "seq_cst";
+  }
+  llvm_unreachable("unknown memory order");
+}
+
+inline char const* atomic_op_name(atomic_op op) {
+  switch (op) {
+  case atomic_op::xchg: return "xchg";
+  case atomic_op::add: return "add";
+  case atomic_op::sub: return "sub";
+  case atomic_op::and_: return "and";
+  case atomic_op::or_: return "or";
+  case atomic_op::xor_: return "xor";
+  case atomic_op::min: return "min";
+  case atomic_op::max: return "max";
+  }
+  llvm_unreachable("unknown atomic operation");
+}
+
+template<typename T> llvm::AtomicRMWInst::BinOp get_atomic_binop(atomic_op op) {
+  if constexpr (LLVMFloatingType<T>) {
+    switch (op) {
+    case atomic_op::xchg: return llvm::AtomicRMWInst::Xchg;
+    case atomic_op::add: return llvm::AtomicRMWInst::FAdd;
+    case atomic_op::sub: return llvm::AtomicRMWInst::FSub;
+    default: assert(false && "only xchg, add and sub operate on floating point values"); abort();
+    }
+  } else {
+    switch (op) {
+    case atomic_op::xchg: return llvm::AtomicRMWInst::Xchg;
+    case atomic_op::add: return llvm::AtomicRMWInst::Add;
+    case atomic_op::sub: return llvm::AtomicRMWInst::Sub;
+    case atomic_op::and_: return llvm::AtomicRMWInst::And;
+    case atomic_op::or_: return llvm::AtomicRMWInst::Or;
+    case atomic_op::xor_: return llvm::AtomicRMWInst::Xor;
+    case atomic_op::min: return std::is_signed_v<T> ? llvm::AtomicRMWInst::Min : llvm::AtomicRMWInst::UMin;
+    case atomic_op::max: return std::is_signed_v<T> ? llvm::AtomicRMWInst::Max : llvm::AtomicRMWInst::UMax;
+    }
+    abort();
+  }
+}
+
+// the ordering of the failed compare-exchange, that does not write, derived as std::atomic does.
+inline std::memory_order get_failure_order(std::memory_order order) {
+  switch (order) {
+  case std::memory_order_acq_rel: return std::memory_order_acquire;
+  case std::memory_order_release: return std::memory_order_relaxed;
+  default: return order;
+  }
+}
+
+// how strong the acquire side of an order is, the failure order of cmpxchg must not be stronger than the success one.
+inline int get_acquire_strength(std::memory_order order) {
+  switch (order) {
+  case std::memory_order_relaxed: [[fallthrough]];
+  case std::memory_order_release: return 0;
+  case std::memory_order_consume: [[fallthrough]];
+  case std::memory_order_acquire: [[fallthrough]];
+  case std::memory_order_acq_rel: return 1;
+  case std::memory_order_seq_cst: return 2;
+  }
+  llvm_unreachable("unknown memory order");
+}
+
+} // namespace detail
+
+// atomic operations require ptr to be aligned to the size of the type.
+
+template<detail::AtomicPointer Ptr> auto atomic_load(Ptr ptr, std::memory_order order = std::memory_order_seq_cst) {
+  assert(order != std::memory_order_release && order != std::memory_order_acq_rel);
+  using value_type = std::remove_cv_t<std::remove_pointer_t<typename Ptr::value_type>>;
+  auto& mb = *module_builder::current_builder();
+
+  auto id = fmt::format("val{}", detail::id_counter++);
+  auto line_no = mb.source_code_.add_line(
+      [&] { return fmt::format("{} = atomic_load({}, {});", id, ptr, detail::memory_order_name(order)); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+  auto v = mb.ir_builder().CreateAlignedLoad(ptr.eval(), llvm::MaybeAlign(sizeof(value_type)));
+  v->setAtomic(detail::get_atomic_ordering(order));
+  return value<value_type>{v, id};
+}
+
+template<typename Value, typename Ptr>
+requires detail::AtomicOperands<Ptr, Value>
+void atomic_store(Value v, Ptr ptr, std::memory_order order = std::memory_order_seq_cst) {
+  assert(order != std::memory_order_consume && order != std::memory_order_acquire &&
+         order != std::memory_order_acq_rel);
+  using value_type = typename Value::value_type;
+  auto& mb = *module_builder::current_builder();
+
+  auto line_no = mb.source_code_.add_line(
+      [&] { return fmt::format("atomic_store({}, {}, {});", ptr, v, detail::memory_order_name(order)); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+  auto store = mb.ir_builder().CreateAlignedStore(v.eval(), ptr.eval(), llvm::MaybeAlign(sizeof(value_type)));
+  store->setAtomic(detail::get_atomic_ordering(order));
+}
+
+// atomically replaces *ptr with the result of op applied to it and v, returns the previous value. floating point
+// values support only xchg, add and sub.
+template<typename Ptr, typename Value>
+requires detail::AtomicOperands<Ptr, Value> && (!LLVMPointerType<typename Value::value_type>)
+value<typename Value::value_type> atomic_rmw(atomic_op op, Ptr ptr, Value v,
+                                             std::memory_order order = std::memory_order_seq_cst) {
+  using value_type = typename Value::value_type;
+  auto& mb = *module_builder::current_builder();
+
+  auto id = fmt::format("val{}", detail::id_counter++);
+  auto line_no = mb.source_code_.add_line([&] {
+    return fmt::format("{} = atomic_fetch_{}({}, {}, {});", id, detail::atomic_op_name(op), ptr, v,
+                       detail::memory_order_name(order));
+  });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+  auto old = mb.ir_builder().CreateAtomicRMW(detail::get_atomic_binop<value_type>(op), ptr.eval(), v.eval(),
+                                             detail::get_atomic_ordering(order));
+  return value<value_type>{old, id};
+}
+
+// stores desired in *ptr if it is equal to expected. the comparison is bitwise, floating point values are not
+// supported.
+template<typename Ptr, typename Expected, typename Desired>
+requires detail::AtomicOperands<Ptr, Expected> && detail::AtomicOperands<Ptr, Desired> &&
+    (!LLVMFloatingType<typename Expected::value_type>)
+cmpxchg_result<typename Expected::value_type> cmpxchg(Ptr ptr, Expected expected, Desired desired,
+                                                      std::memory_order success, std::memory_order failure) {
+  assert(failure != std::memory_order_release && failure != std::memory_order_acq_rel);
+  assert(detail::get_acquire_strength(failure) <= detail::get_acquire_strength(success));
+  using value_type = typename Expected::value_type;
+  auto& mb = *module_builder::current_builder();
+
+  auto id = fmt::format("cmpxchg{}", detail::id_counter++);
+  auto line_no = mb.source_code_.add_line([&] {
+    return fmt::format("{} = cmpxchg({}, {}, {}, {}, {});", id, ptr, expected, desired,
+                       detail::memory_order_name(success), detail::memory_order_name(failure));
+  });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+  auto result =
+      mb.ir_builder().CreateAtomicCmpXchg(ptr.eval(), expected.eval(), desired.eval(),
+                                          detail::get_atomic_ordering(success), detail::get_atomic_ordering(failure));
+  return cmpxchg_result<value_type>{value<value_type>{mb.ir_builder().CreateExtractValue(result, 0), id + ".old"},
+                                    value<bool>{mb.ir_builder().CreateExtractValue(result, 1), id + ".success"}};
+}
+
+template<typename Ptr, typename Expected, typename Desired>
+requires detail::AtomicOperands<Ptr, Expected> && detail::AtomicOperands<Ptr, Desired> &&
+    (!LLVMFloatingType<typename Expected::value_type>)
+cmpxchg_result<typename Expected::value_type> cmpxchg(Ptr ptr, Expected expected, Desired desired,
+                                                      std::memory_order order = std::memory_order_seq_cst) {
+  return cmpxchg(ptr, expected, desired, order, detail::get_failure_order(order));
+}
+
+inline void fence(std::memory_order order = std::memory_order_seq_cst) {
+  assert(order != std::memory_order_relaxed);
+  auto& mb = *module_builder::current_builder();
+
+  auto line_no =
+      mb.source_code_.add_line([&] { return fmt::format("fence({});", detail::memory_order_name(order)); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+  mb.ir_builder().CreateFence(detail::get_atomic_ordering(order));
+}
+
+} // namespace codegen
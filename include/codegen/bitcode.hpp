@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "aot.hpp"
+#include "module.hpp"
+#include "utils.hpp"
+
+namespace codegen {
+
+namespace detail {
+
+// named metadata holding the signatures of the functions of a saved module, one node per function with its name,
+// return type and parameter declarations.
+inline constexpr char const* signatures_metadata = "codegen.signatures";
+
+inline void add_signatures(llvm::Module& module, std::vector<function_signature> const& signatures) {
+  auto& context = module.getContext();
+  auto md = module.getOrInsertNamedMetadata(signatures_metadata);
+  for (auto& sig : signatures) {
+    auto fields = std::vector<llvm::Metadata*>{llvm::MDString::get(context, sig.name),
+                                               llvm::MDString::get(context, sig.return_type)};
+    for (auto& arg : sig.arguments) { fields.emplace_back(llvm::MDString::get(context, arg)); }
+    md->addOperand(llvm::MDNode::get(context, fields));
+  }
+}
+
+inline std::vector<function_signature> get_signatures(llvm::Module const& module) {
+  auto signatures = std::vector<function_signature>{};
+  auto md = module.getNamedMetadata(signatures_metadata);
+  if (!md) { return signatures; }
+  for (auto node : md->operands()) {
+    auto field = [&](unsigned idx) { return llvm::cast<llvm::MDString>(node->getOperand(idx))->getString().str(); };
+    auto& sig = signatures.emplace_back(function_signature{field(0), field(1), {}});
+    for (auto i = 2u; i < node->getNumOperands(); i++) { sig.arguments.emplace_back(field(i)); }
+  }
+  return signatures;
+}
+
+inline void write_bitcode(std::filesystem::path const& path, llvm::Module const& module) {
+  auto ec = std::error_code{};
+  auto os = llvm::raw_fd_ostream(path.string(), ec, llvm::sys::fs::OF_None);
+  if (ec) { throw llvm_error(llvm::errorCodeToError(ec)); }
+  llvm::WriteBitcodeToFile(module, os);
+}
+
+} // namespace detail
+
+// compiles a module saved with module_builder::save_bitcode(), without running its generator again. functions
+// declared with declare_external_function() are resolved by name, in the symbols of the process and those added with
+// compiler_context::add_symbol(). their addresses are not saved, they do not survive a restart of the process.
+inline module load_bitcode(compiler_context& c, std::filesystem::path const& path) {
+  auto start = std::chrono::steady_clock::now();
+
+  auto buffer = llvm::MemoryBuffer::getFile(path.string());
+  if (!buffer) { throw llvm_error(llvm::errorCodeToError(buffer.getError())); }
+  auto context = std::make_unique<llvm::LLVMContext>();
+  auto parsed = llvm::parseBitcodeFile(**buffer, *context);
+  if (!parsed) { throw llvm_error(parsed.takeError()); }
+  auto ir = std::move(*parsed);
+
+  auto resources = std::make_shared<detail::module_resources>(c, ir->getName().str());
+  auto signatures = std::unordered_map<std::string, detail::function_signature>{};
+  for (auto& sig : detail::get_signatures(*ir)) { signatures.emplace(sig.name, std::move(sig)); }
+
+  c.runtime_.link_into(*ir, c.target_cpu(), c.target_features());
+
+  auto& statistics = resources->statistics();
+  statistics.set_functions(detail::get_function_statistics(*ir));
+  statistics.add_time(detail::compile_phase::ir_generation, std::chrono::steady_clock::now() - start);
+
+  if (c.is_tiered()) {
+    resources->compile_tiered(
+        llvm::orc::ThreadSafeModule(std::move(ir), llvm::orc::ThreadSafeContext(std::move(context))));
+  } else {
+    throw_on_error(c.compileModule(resources->tracker(), std::move(ir), std::move(context)));
+  }
+  return module{std::move(resources), {}, std::move(signatures)};
+}
+
+} // namespace codegen
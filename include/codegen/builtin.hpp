@@ -25,6 +25,49 @@
 #include "codegen/module_builder.hpp"
 
 #include "types.hpp"
+#include "vector.hpp"
+
+namespace codegen::detail {
+
+template<typename Ptr> using pointee_type = std::remove_cv_t<std::remove_pointer_t<typename Ptr::value_type>>;
+
+// vector of the elements a pointer points to, with as many lanes as the mask.
+template<typename Ptr, typename Mask> using masked_vector_type = vec<pointee_type<Ptr>, Mask::value_type::size>;
+
+template<typename Ptr>
+concept ElementPointer = Pointer<Ptr>&& LLVMArithmeticType<pointee_type<Ptr>> && (!LLVMBoolType<pointee_type<Ptr>>);
+
+template<typename Ptr>
+concept MutableElementPointer =
+    ElementPointer<Ptr> && (!std::is_const_v<std::remove_pointer_t<typename Ptr::value_type>>);
+
+template<size_t N> value<vec<bool, N>> all_lanes() {
+  return value<vec<bool, N>>{llvm::Constant::getAllOnesValue(type<vec<bool, N>>::llvm()), "true"};
+}
+
+template<typename Vector> value<Vector> zero_lanes() {
+  return value<Vector>{llvm::Constant::getNullValue(type<Vector>::llvm()), "0"};
+}
+
+// widens vector indices to 64 bits as pointer arithmetic does with scalar ones.
+template<typename Indices> llvm::Value* extend_indices(llvm::IRBuilder<>& builder, Indices const& indices) {
+  using index_type = typename Indices::value_type::element_type;
+  auto idx = indices.eval();
+  if constexpr (sizeof(index_type) < sizeof(uint64_t)) {
+    auto wide = type<vec<int64_t, Indices::value_type::size>>::llvm();
+    idx = std::is_unsigned_v<index_type> ? builder.CreateZExt(idx, wide) : builder.CreateSExt(idx, wide);
+  }
+  return idx;
+}
+
+inline llvm::Value* count_lanes(llvm::IRBuilder<>& builder, llvm::Value* mask) {
+  auto lanes = llvm::cast<llvm::FixedVectorType>(mask->getType())->getNumElements();
+  auto bits = builder.CreateBitCast(mask, builder.getIntNTy(lanes));
+  auto count = builder.CreateUnaryIntrinsic(llvm::Intrinsic::ctpop, bits);
+  return builder.CreateZExtOrTrunc(count, type<uint32_t>::llvm());
+}
+
+} // namespace codegen::detail
 
 namespace codegen::builtin {
 
@@ -34,7 +77,7 @@ void memcpy(PointerValue auto dst, PointerValue auto src, Size auto n) {
   using namespace detail;
   auto& mb = *module_builder::current_builder();
 
-  auto line_no = mb.source_code_.add_line(fmt::format("memcpy({}, {}, {});", dst, src, n));
+  auto line_no = mb.source_code_.add_line([&] { return fmt::format("memcpy({}, {}, {});", dst, src, n); });
   mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no, 1));
   mb.ir_builder().CreateMemCpy(
       dst.eval(), llvm::MaybeAlign(detail::type<typename decltype(dst)::value_type>::alignment), src.eval(),
@@ -49,11 +92,193 @@ value<int> memcmp(Pointer auto src1, Pointer auto src2, Size auto n) {
                                          {type<void*>::llvm(), type<void*>::llvm(), type<size_t>::llvm()}, false);
   auto fn = llvm::Function::Create(fn_type, llvm::GlobalValue::LinkageTypes::ExternalLinkage, "memcmp", mb.module());
 
-  auto line_no = mb.source_code_.add_line(fmt::format("memcmp_ret = memcmp({}, {}, {});", src1, src2, n));
+  auto line_no =
+      mb.source_code_.add_line([&] { return fmt::format("memcmp_ret = memcmp({}, {}, {});", src1, src2, n); });
   mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no, 1));
   return value<int>{mb.ir_builder().CreateCall(fn, {src1.eval(), src2.eval(), n.eval()}), "memcmp_ret"};
 }
 
+// the byte value is given as an 8-bit integer, as in std::memset().
+template<typename Value>
+requires LLVMTypeWrapper<Value> && LLVMIntegralType<typename Value::value_type> &&
+    (sizeof(typename Value::value_type) == 1)
+void memset(PointerValue auto dst, Value v, Size auto n) {
+  using namespace detail;
+  auto& mb = *module_builder::current_builder();
+
+  auto line_no = mb.source_code_.add_line([&] { return fmt::format("memset({}, {}, {});", dst, v, n); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no, 1));
+  using pointee_type = std::remove_cv_t<std::remove_pointer_t<typename decltype(dst)::value_type>>;
+  mb.ir_builder().CreateMemSet(dst.eval(), v.eval(), n.eval(), llvm::MaybeAlign(type<pointee_type>::alignment));
+}
+
+enum class prefetch_access {
+  read,
+  write,
+};
+
+// hints that the memory at ptr is going to be accessed soon. locality ranges from 0, no temporal locality, the data
+// is used once and does not need to stay in the cache, to 3, keep it in all levels of the cache.
+void prefetch(PointerValue auto ptr, prefetch_access rw = prefetch_access::read, unsigned locality = 3) {
+  using namespace detail;
+  assert(locality <= 3);
+  auto& mb = *module_builder::current_builder();
+
+  auto line_no = mb.source_code_.add_line([&] {
+    return fmt::format("prefetch({}, {}, {});", ptr, rw == prefetch_access::read ? "read" : "write", locality);
+  });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no, 1));
+  auto i32 = [&](unsigned v) { return llvm::ConstantInt::get(type<int32_t>::llvm(), v); };
+  auto address = mb.ir_builder().CreateBitCast(ptr.eval(), type<std::byte*>::llvm());
+  // the last argument selects the data cache.
+  mb.ir_builder().CreateIntrinsic(llvm::Intrinsic::prefetch, {address->getType()},
+                                  {address, i32(rw == prefetch_access::write), i32(locality), i32(1)});
+}
+
+// store that bypasses the caches, for output that is written once and not read again soon. ptr must be aligned to
+// alignment, by default that of a single element. vectors are written with streaming instructions only if it is at
+// least the size of the whole vector.
+template<typename Value, typename Ptr>
+requires Pointer<Ptr> && (!std::is_const_v<std::remove_pointer_t<typename Ptr::value_type>>) &&
+    (std::same_as<typename Value::value_type, std::remove_pointer_t<typename Ptr::value_type>> ||
+     std::same_as<detail::element_type_t<typename Value::value_type>, std::remove_pointer_t<typename Ptr::value_type>>)
+void stream_store(Value v, Ptr ptr,
+                  size_t alignment = detail::type<std::remove_pointer_t<typename Ptr::value_type>>::alignment) {
+  using value_type = typename Value::value_type;
+  assert(alignment && !(alignment & (alignment - 1)));
+  auto& mb = *module_builder::current_builder();
+
+  auto line_no = mb.source_code_.add_line([&] { return fmt::format("stream_store({}, {});", v, ptr); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no, 1));
+  auto address = mb.ir_builder().CreateBitCast(ptr.eval(), detail::type<value_type>::llvm()->getPointerTo());
+  auto store = mb.ir_builder().CreateAlignedStore(v.eval(), address, llvm::MaybeAlign(alignment));
+  auto one = llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(detail::type<int32_t>::llvm(), 1));
+  store->setMetadata(llvm::LLVMContext::MD_nontemporal, llvm::MDNode::get(mb.context(), {one}));
+}
+
+// masked memory operations. lanes whose mask bit is not set do not access memory, so that a vector may extend past
+// the end of a buffer. loads return the lanes of passthru there, zeros if it is not given.
+
+template<detail::ElementPointer Ptr, detail::MaskValue Mask, VectorValue PassThru>
+requires std::same_as<typename PassThru::value_type, detail::masked_vector_type<Ptr, Mask>>
+value<typename PassThru::value_type> masked_load(Ptr ptr, Mask mask, PassThru passthru) {
+  using vector_type = typename PassThru::value_type;
+  return detail::emit_vector_operation<vector_type>(
+      [&] { return fmt::format("masked_load({}, {}, {})", ptr, mask, passthru); },
+      [&](auto& builder) {
+        auto address = builder.CreateBitCast(ptr.eval(), detail::type<vector_type>::llvm()->getPointerTo());
+        return builder.CreateMaskedLoad(address, llvm::Align(detail::type<vector_type>::alignment), mask.eval(),
+                                        passthru.eval());
+      });
+}
+
+template<detail::ElementPointer Ptr, detail::MaskValue Mask> auto masked_load(Ptr ptr, Mask mask) {
+  return masked_load(ptr, mask, detail::zero_lanes<detail::masked_vector_type<Ptr, Mask>>());
+}
+
+template<VectorValue Value, detail::MutableElementPointer Ptr, detail::MaskValue Mask>
+requires std::same_as<typename Value::value_type, detail::masked_vector_type<Ptr, Mask>>
+void masked_store(Value v, Ptr ptr, Mask mask) {
+  using vector_type = typename Value::value_type;
+  auto& mb = *module_builder::current_builder();
+
+  auto line_no = mb.source_code_.add_line([&] { return fmt::format("masked_store({}, {}, {});", v, ptr, mask); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no, 1));
+  auto address = mb.ir_builder().CreateBitCast(ptr.eval(), detail::type<vector_type>::llvm()->getPointerTo());
+  mb.ir_builder().CreateMaskedStore(v.eval(), address, llvm::Align(detail::type<vector_type>::alignment),
+                                    mask.eval());
+}
+
+// lane i of the result is base[indices[i]].
+template<detail::ElementPointer Ptr, VectorValue Indices, detail::MaskValue Mask, VectorValue PassThru>
+requires IntegralValue<Indices> && std::same_as<typename PassThru::value_type, detail::masked_vector_type<Ptr, Mask>> &&
+    (Indices::value_type::size == Mask::value_type::size)
+value<typename PassThru::value_type> gather(Ptr base, Indices indices, Mask mask, PassThru passthru) {
+  using vector_type = typename PassThru::value_type;
+  return detail::emit_vector_operation<vector_type>(
+      [&] { return fmt::format("gather({}, {}, {}, {})", base, indices, mask, passthru); },
+      [&](auto& builder) {
+        auto addresses = builder.CreateInBoundsGEP(base.eval(), detail::extend_indices(builder, indices));
+        return builder.CreateMaskedGather(addresses, llvm::Align(detail::type<vector_type>::alignment), mask.eval(),
+                                          passthru.eval());
+      });
+}
+
+template<detail::ElementPointer Ptr, VectorValue Indices, detail::MaskValue Mask>
+requires IntegralValue<Indices> && (Indices::value_type::size == Mask::value_type::size)
+auto gather(Ptr base, Indices indices, Mask mask) {
+  return gather(base, indices, mask, detail::zero_lanes<detail::masked_vector_type<Ptr, Mask>>());
+}
+
+template<detail::ElementPointer Ptr, VectorValue Indices>
+requires IntegralValue<Indices> auto gather(Ptr base, Indices indices) {
+  return gather(base, indices, detail::all_lanes<Indices::value_type::size>());
+}
+
+// base[indices[i]] = v[i]. if several lanes write to the same element, the one with the highest index wins.
+template<VectorValue Value, detail::MutableElementPointer Ptr, VectorValue Indices, detail::MaskValue Mask>
+requires IntegralValue<Indices> && std::same_as<typename Value::value_type, detail::masked_vector_type<Ptr, Mask>> &&
+    (Indices::value_type::size == Mask::value_type::size)
+void scatter(Value v, Ptr base, Indices indices, Mask mask) {
+  using vector_type = typename Value::value_type;
+  auto& mb = *module_builder::current_builder();
+
+  auto line_no =
+      mb.source_code_.add_line([&] { return fmt::format("scatter({}, {}, {}, {});", v, base, indices, mask); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no, 1));
+  auto addresses = mb.ir_builder().CreateInBoundsGEP(base.eval(), detail::extend_indices(mb.ir_builder(), indices));
+  mb.ir_builder().CreateMaskedScatter(v.eval(), addresses, llvm::Align(detail::type<vector_type>::alignment),
+                                      mask.eval());
+}
+
+template<VectorValue Value, detail::MutableElementPointer Ptr, VectorValue Indices>
+requires IntegralValue<Indices> void scatter(Value v, Ptr base, Indices indices) {
+  scatter(v, base, indices, detail::all_lanes<Indices::value_type::size>());
+}
+
+// stores the lanes whose mask bit is set to consecutive elements at ptr and returns how many were stored, which is
+// how far the output of a filter advances.
+template<VectorValue Value, detail::MutableElementPointer Ptr, detail::MaskValue Mask>
+requires std::same_as<typename Value::value_type, detail::masked_vector_type<Ptr, Mask>>
+value<uint32_t> compress_store(Value v, Ptr ptr, Mask mask) {
+  using vector_type = typename Value::value_type;
+  auto& mb = *module_builder::current_builder();
+
+  auto id = fmt::format("stored{}", detail::id_counter++);
+  auto line_no =
+      mb.source_code_.add_line([&] { return fmt::format("{} = compress_store({}, {}, {});", id, v, ptr, mask); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no, 1));
+  auto mask_value = mask.eval();
+  auto store = mb.ir_builder().CreateIntrinsic(llvm::Intrinsic::masked_compressstore,
+                                               {detail::type<vector_type>::llvm()},
+                                               {v.eval(), ptr.eval(), mask_value});
+  // the lanes are stored at any element, not at a multiple of the vector size.
+  store->addParamAttr(1, llvm::Attribute::getWithAlignment(
+                             mb.context(), llvm::Align(detail::type<detail::element_type_t<vector_type>>::alignment)));
+  return value<uint32_t>{detail::count_lanes(mb.ir_builder(), mask_value), id};
+}
+
+// the opposite of compress_store(), lanes whose mask bit is set are loaded from consecutive elements at ptr.
+template<detail::ElementPointer Ptr, detail::MaskValue Mask, VectorValue PassThru>
+requires std::same_as<typename PassThru::value_type, detail::masked_vector_type<Ptr, Mask>>
+value<typename PassThru::value_type> expand_load(Ptr ptr, Mask mask, PassThru passthru) {
+  using vector_type = typename PassThru::value_type;
+  auto& mb = *module_builder::current_builder();
+  return detail::emit_vector_operation<vector_type>(
+      [&] { return fmt::format("expand_load({}, {}, {})", ptr, mask, passthru); },
+      [&](auto& builder) {
+        auto load = builder.CreateIntrinsic(llvm::Intrinsic::masked_expandload, {detail::type<vector_type>::llvm()},
+                                            {ptr.eval(), mask.eval(), passthru.eval()});
+        auto alignment = llvm::Align(detail::type<detail::element_type_t<vector_type>>::alignment);
+        load->addParamAttr(0, llvm::Attribute::getWithAlignment(mb.context(), alignment));
+        return load;
+      });
+}
+
+template<detail::ElementPointer Ptr, detail::MaskValue Mask> auto expand_load(Ptr ptr, Mask mask) {
+  return expand_load(ptr, mask, detail::zero_lanes<detail::masked_vector_type<Ptr, Mask>>());
+}
+
 namespace detail {
 
 template<typename Value> class bswap_impl {
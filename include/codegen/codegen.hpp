@@ -8,17 +8,28 @@
 #pragma clang diagnostic ignored "-Wredundant-move"
 #endif
 
+#include "aot.hpp"
 #include "arithmetic_ops.hpp"
+#include "atomic.hpp"
+#include "bitcode.hpp"
 #include "builtin.hpp"
 #include "compiler_context.hpp"
 #include "literals.hpp"
+#include "memory_manager.hpp"
 #include "module.hpp"
 #include "module_builder.hpp"
+#include "module_cache.hpp"
+#include "object_cache.hpp"
+#include "optimizer.hpp"
 #include "relational_ops.hpp"
+#include "runtime_library.hpp"
+#include "shared_code_cache.hpp"
 #include "statements.hpp"
+#include "statistics.hpp"
 #include "types.hpp"
 #include "utils.hpp"
 #include "variable.hpp"
+#include "vector.hpp"
 
 #include <llvm/Support/InitLLVM.h>
 #include <llvm/Support/TargetSelect.h>
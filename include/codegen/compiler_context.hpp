@@ -22,8 +22,18 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <llvm/ExecutionEngine/JITEventListener.h>
 
@@ -38,18 +48,186 @@
 
 #include <llvm/ExecutionEngine/Orc/LLJIT.h>
 
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/SubtargetFeature.h>
 #include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/ThreadPool.h>
 
+#include <fmt/format.h>
+
+#include "memory_manager.hpp"
+#include "module_cache.hpp"
+#include "optimizer.hpp"
+#include "perf_listener.hpp"
+#include "runtime_library.hpp"
+#include "shared_code_cache.hpp"
+#include "statistics.hpp"
+#include "tiering.hpp"
 #include "utils.hpp"
 
 namespace codegen {
 
+class module;
+
+namespace detail {
+class module_resources;
+} // namespace detail
+
+// the machine the code is compiled for. unset fields are taken from the host. if the cpu is set, the features
+// default to those of that cpu rather than the host.
+struct target_description {
+  std::optional<std::string> cpu;
+  // comma separated, e.g. "+avx2,-avx512f". applied on top of the default features.
+  std::optional<std::string> features;
+  std::optional<llvm::CodeModel::Model> code_model;
+  std::optional<llvm::Reloc::Model> relocation_model;
+};
+
+namespace detail {
+
+inline llvm::orc::JITTargetMachineBuilder get_target_machine_builder(target_description const& target) {
+  auto tmb = cantFail(llvm::orc::JITTargetMachineBuilder::detectHost());
+  if (target.cpu) {
+    tmb.setCPU(*target.cpu);
+    tmb.getFeatures() = llvm::SubtargetFeatures();
+  }
+  if (target.features) {
+    for (auto& feature : llvm::SubtargetFeatures(*target.features).getFeatures()) {
+      tmb.getFeatures().AddFeature(feature);
+    }
+  }
+  if (target.code_model) { tmb.setCodeModel(*target.code_model); }
+  if (target.relocation_model) { tmb.setRelocationModel(*target.relocation_model); }
+  return tmb;
+}
+
+// library functions the generated code itself may call, e.g. for memcpy intrinsics, builtin::memcmp, floating point
+// remainder or math intrinsics without a native instruction. the helpers of compiler-rt are not needed, the values
+// the dsl supports never lower to them.
+inline std::vector<std::pair<char const*, void*>> get_libcalls() {
+  using unary = double (*)(double);
+  using binary = double (*)(double, double);
+  using ternary = double (*)(double, double, double);
+  auto fn = [](auto f) { return reinterpret_cast<void*>(f); };
+  return {
+      {"memcpy", fn(&::memcpy)},
+      {"memmove", fn(&::memmove)},
+      {"memset", fn(&::memset)},
+      {"memcmp", fn(&::memcmp)},
+      {"fmod", fn(static_cast<binary>(&::fmod))},
+      {"fmodf", fn(&::fmodf)},
+      {"sqrt", fn(static_cast<unary>(&::sqrt))},
+      {"sqrtf", fn(&::sqrtf)},
+      {"pow", fn(static_cast<binary>(&::pow))},
+      {"powf", fn(&::powf)},
+      {"exp", fn(static_cast<unary>(&::exp))},
+      {"expf", fn(&::expf)},
+      {"exp2", fn(static_cast<unary>(&::exp2))},
+      {"exp2f", fn(&::exp2f)},
+      {"log", fn(static_cast<unary>(&::log))},
+      {"logf", fn(&::logf)},
+      {"log2", fn(static_cast<unary>(&::log2))},
+      {"log2f", fn(&::log2f)},
+      {"log10", fn(static_cast<unary>(&::log10))},
+      {"log10f", fn(&::log10f)},
+      {"sin", fn(static_cast<unary>(&::sin))},
+      {"sinf", fn(&::sinf)},
+      {"cos", fn(static_cast<unary>(&::cos))},
+      {"cosf", fn(&::cosf)},
+      {"floor", fn(static_cast<unary>(&::floor))},
+      {"floorf", fn(&::floorf)},
+      {"ceil", fn(static_cast<unary>(&::ceil))},
+      {"ceilf", fn(&::ceilf)},
+      {"trunc", fn(static_cast<unary>(&::trunc))},
+      {"truncf", fn(&::truncf)},
+      {"round", fn(static_cast<unary>(&::round))},
+      {"roundf", fn(&::roundf)},
+      {"rint", fn(static_cast<unary>(&::rint))},
+      {"rintf", fn(&::rintf)},
+      {"nearbyint", fn(static_cast<unary>(&::nearbyint))},
+      {"nearbyintf", fn(&::nearbyintf)},
+      {"fmin", fn(static_cast<binary>(&::fmin))},
+      {"fminf", fn(&::fminf)},
+      {"fmax", fn(static_cast<binary>(&::fmax))},
+      {"fmaxf", fn(&::fmaxf)},
+      {"fma", fn(static_cast<ternary>(&::fma))},
+      {"fmaf", fn(&::fmaf)},
+  };
+}
+
+// identifies everything about the target that affects the generated code, unset models are written as "default".
+inline std::string get_target_id(llvm::orc::JITTargetMachineBuilder const& tmb) {
+  auto model = [](auto const& m) { return m ? std::to_string(static_cast<int>(*m)) : std::string("default"); };
+  return fmt::format("{}-{}-{}-{}-{}", tmb.getTargetTriple().str(), tmb.getCPU(), tmb.getFeatures().getString(),
+                     model(tmb.getCodeModel()), model(tmb.getRelocationModel()));
+}
+
+} // namespace detail
+
+struct compiler_options {
+  // O0 does not run the IR optimization pipeline, the machine code is still generated at the default level.
+  optimization_level level = optimization_level::O0;
+
+  // number of threads compiling modules in the background. with 0, modules are compiled on the thread that first
+  // looks up their symbols.
+  unsigned compile_threads = 0;
+
+  // compiles each function separately on its first call, through a stub, instead of compiling whole modules upfront.
+  bool lazy = false;
+
+  // if not 0, functions are first compiled at O0 and recompiled at O3 in the background once they have been called
+  // that many times. calls are redirected through stubs, so addresses obtained earlier pick up the optimized code.
+  // cannot be combined with lazy.
+  uint64_t tier_up_threshold = 0;
+
+  // registers compiled code with the gdb jit interface and keeps the debug sections of object files. disable together
+  // with the debug codegen of module_builder for the lowest compilation latency.
+  bool debug_info = true;
+
+  // writes /tmp/perf-<pid>.map, which lets perf report resolve the names of compiled functions.
+  bool perf_map = false;
+
+  // writes a jitdump file with the code and line numbers of compiled functions, for perf annotate. the line numbers
+  // refer to the source generated by module_builder and are available only with debug_info and debug codegen
+  // enabled. requires LLVM built with LLVM_USE_PERF, the profile has to go through perf inject --jit.
+  bool jitdump = false;
+
+  // allocates code and data of all objects from large arenas shared by the whole context, instead of separate
+  // mappings for each object. arenas are returned to the system once the last module using them is destroyed.
+  // available only on linux, the context throws elsewhere.
+  bool arena_memory = false;
+  size_t arena_size = 2 << 20;
+  // backs the arenas with transparent huge pages, if the system allows it. requires arena_memory.
+  bool huge_pages = false;
+
+  // creates the memory manager of each compiled object. takes precedence over arena_memory.
+  std::function<std::unique_ptr<llvm::RuntimeDyld::MemoryManager>()> memory_manager;
+
+  // used for the data layout, the target attributes of generated functions and code generation.
+  target_description target;
+
+  // makes all symbols of the process visible to the generated code. without it, only the symbols registered with
+  // add_symbol() or declare_external_function() and the libc and libm functions the generated code may depend on
+  // are, see detail::get_libcalls().
+  bool process_symbols = true;
+};
+
 class compiler_context {
   llvm::orc::ExecutionSession session_;
 
   llvm::DataLayout data_layout_;
 
+  llvm::orc::JITTargetMachineBuilder target_machine_builder_;
+
+  // declared before the JIT, its compile threads may still record statistics while it shuts down.
+  detail::compile_statistics statistics_;
+  std::unique_ptr<detail::arena_allocator> arena_;
+  detail::pending_phases pending_phases_;
+  // statistics of the live modules, by their JITDylibs.
+  std::mutex module_statistics_mutex_;
+  std::unordered_map<llvm::orc::JITDylib const*, std::shared_ptr<detail::module_statistics>> module_statistics_;
+
   std::unique_ptr<llvm::orc::LLJIT> lljit_;
 
   llvm::orc::MangleAndInterner mangle_;
@@ -58,42 +236,254 @@ class compiler_context {
 
   const std::string name_;
 
+  optimization_level optimization_level_;
+
+  bool lazy_;
+
+  object_cache object_cache_;
+
+  shared_code_cache shared_code_cache_;
+
+  // JITDylibs of unloaded modules, ready to be reused by new ones.
+  std::mutex free_dylibs_mutex_;
+  std::vector<llvm::orc::JITDylib*> free_dylibs_;
+
+  // stubs of the functions of destroyed tiered modules, ready to be reused. the stubs manager cannot free them.
+  std::mutex free_stubs_mutex_;
+  std::vector<std::string> free_stubs_;
+
+  // declared after the JIT and the free lists, cached modules are unloaded before those are destroyed.
+  module_cache module_cache_;
+
+  uint64_t tier_up_threshold_;
+  std::atomic<uint64_t> tier_ups_{0};
+  std::unique_ptr<llvm::orc::IndirectStubsManager> stubs_;
+
   std::unordered_map<std::string, llvm::StructType*> custom_types;
 
+  detail::runtime_library runtime_;
+
+  // declared last, pending recompilations finish before anything else is destroyed.
+  std::unique_ptr<llvm::ThreadPool> tier_up_threads_;
+
   friend class module_builder;
+  friend class detail::module_resources;
+  friend module load_bitcode(compiler_context& c, std::filesystem::path const& path);
 
 private:
   explicit compiler_context(std::string const& context_name, llvm::orc::JITTargetMachineBuilder tmb,
-                    std::string const& name = "LLVM_JIT")
-      : data_layout_(cantFail(tmb.getDefaultDataLayoutForTarget())), mangle_(session_, data_layout_),
-        gdb_listener_(llvm::JITEventListener::createGDBRegistrationListener()), name_(name) {
-    auto jtmb = cantFail(llvm::orc::JITTargetMachineBuilder::detectHost());
-    lljit_ = cantFail(
-        (llvm::orc::LLJITBuilder()
-             .setJITTargetMachineBuilder(std::move(jtmb))
-             .setObjectLinkingLayerCreator([&](llvm::orc::ExecutionSession& ES, const llvm::Triple& TT) {
-               auto GetMemMgr = []() { return std::make_unique<llvm::SectionMemoryManager>(); };
-               auto ObjLinkingLayer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(ES, std::move(GetMemMgr));
-
-               // Register the event listener.
-               ObjLinkingLayer->registerJITEventListener(*llvm::JITEventListener::createGDBRegistrationListener());
-
-               // Make sure the debug info sections aren't stripped.
-               ObjLinkingLayer->setProcessAllSections(true);
-               return ObjLinkingLayer;
-             })
-             .create()));
-
-    lljit_->getMainJITDylib().addGenerator(
-        // TODO: should we expose all symbols to JIT?
-        cantFail(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
-            data_layout_.getGlobalPrefix(),
-            [MainName = mangle_("main")](const llvm::orc::SymbolStringPtr& Name) { return Name != MainName; })));
+                            compiler_options const& options, std::string const& name = "LLVM_JIT")
+      : data_layout_(cantFail(tmb.getDefaultDataLayoutForTarget())), target_machine_builder_(tmb),
+        mangle_(session_, data_layout_), gdb_listener_(llvm::JITEventListener::createGDBRegistrationListener()),
+        name_(name), optimization_level_(options.level), lazy_(options.lazy),
+        object_cache_(fmt::format("{}-{}", detail::get_target_id(tmb), static_cast<unsigned>(options.level))),
+        shared_code_cache_(detail::get_target_id(tmb)),
+        tier_up_threshold_(options.tier_up_threshold) {
+    assert(!(lazy_ && tier_up_threshold_) && "tiered compilation cannot be combined with lazy compilation");
+    auto perf_listener = options.jitdump ? llvm::JITEventListener::createPerfJITEventListener() : nullptr;
+    if (options.jitdump && !perf_listener) {
+      throw llvm_error(llvm::make_error<llvm::StringError>("jitdump requires LLVM built with perf support",
+                                                           llvm::inconvertibleErrorCode()));
+    }
+
+    assert((options.arena_memory || !options.huge_pages) && "huge pages require arena memory");
+    if (options.arena_memory && !options.memory_manager) {
+      if (!detail::arena_allocator::supported) {
+        throw llvm_error(llvm::make_error<llvm::StringError>("arena memory is not supported on this system",
+                                                             llvm::inconvertibleErrorCode()));
+      }
+      arena_ = std::make_unique<detail::arena_allocator>(options.arena_size, options.huge_pages);
+    }
+
+    auto jtmb = tmb;
+    auto create_jit = [&](auto&& builder) {
+      return cantFail(
+          builder.setJITTargetMachineBuilder(std::move(jtmb))
+              .setNumCompileThreads(options.compile_threads)
+              .setCompileFunctionCreator([this](llvm::orc::JITTargetMachineBuilder jtmb)
+                                             -> llvm::Expected<std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+                return std::make_unique<detail::module_compiler>(std::move(jtmb), optimization_level_,
+                                                                &object_cache_, &pending_phases_);
+              })
+              .setObjectLinkingLayerCreator([&](llvm::orc::ExecutionSession& ES, const llvm::Triple& TT) {
+                auto GetMemMgr = [&]() -> llvm::orc::RTDyldObjectLinkingLayer::GetMemoryManagerFunction {
+                  if (options.memory_manager) { return options.memory_manager; }
+                  if (arena_) {
+                    return [arena = arena_.get()] { return std::make_unique<detail::arena_memory_manager>(*arena); };
+                  }
+                  return [] { return std::make_unique<llvm::SectionMemoryManager>(); };
+                }();
+                auto ObjLinkingLayer =
+                    std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(ES, std::move(GetMemMgr));
+                ObjLinkingLayer->setNotifyLoaded([this](llvm::orc::MaterializationResponsibility& r,
+                                                        llvm::object::ObjectFile const& object,
+                                                        llvm::RuntimeDyld::LoadedObjectInfo const& info) {
+                  auto statistics = get_module_statistics(r.getTargetJITDylib());
+                  if (!statistics) { return; }
+                  auto size = size_t(0);
+                  for (auto& section : object.sections()) {
+                    if (info.getSectionLoadAddress(section)) { size += section.getSize(); }
+                  }
+                  statistics->add_loaded(size);
+                });
+                ObjLinkingLayer->setNotifyEmitted(
+                    [this](llvm::orc::MaterializationResponsibility&, std::unique_ptr<llvm::MemoryBuffer> object) {
+                      pending_phases_.finish(object.get(), detail::compile_phase::linking);
+                    });
+
+                if (options.perf_map) { ObjLinkingLayer->registerJITEventListener(detail::perf_map_listener::get()); }
+                if (perf_listener) { ObjLinkingLayer->registerJITEventListener(*perf_listener); }
+
+                if (!options.debug_info) { return ObjLinkingLayer; }
+
+                // Register the event listener.
+                ObjLinkingLayer->registerJITEventListener(*gdb_listener_);
+
+                // Make sure the debug info sections aren't stripped.
+                ObjLinkingLayer->setProcessAllSections(true);
+                return ObjLinkingLayer;
+              })
+              .create());
+    };
+    if (lazy_) {
+      lljit_ = create_jit(llvm::orc::LLLazyJITBuilder());
+    } else {
+      lljit_ = create_jit(llvm::orc::LLJITBuilder());
+    }
+
+    if (options.process_symbols) {
+      lljit_->getMainJITDylib().addGenerator(
+          cantFail(llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+              data_layout_.getGlobalPrefix(),
+              [MainName = mangle_("main")](const llvm::orc::SymbolStringPtr& Name) { return Name != MainName; })));
+    } else {
+      for (auto& [name, address] : detail::get_libcalls()) { add_symbol(name, address); }
+    }
+
+    if (tier_up_threshold_) {
+      stubs_ = llvm::orc::createLocalIndirectStubsManagerBuilder(tmb.getTargetTriple())();
+      tier_up_threads_ = std::make_unique<llvm::ThreadPool>(llvm::hardware_concurrency(1));
+      cantFail(lljit_->getMainJITDylib().define(
+          llvm::orc::absoluteSymbols({{lljit_->mangleAndIntern(detail::tier_up_function_name),
+                                       llvm::JITEvaluatedSymbol::fromPointer(&detail::tier_up)}})));
+    }
+
+    lljit_->getIRTransformLayer().setTransform(
+        [this](llvm::orc::ThreadSafeModule tsm,
+               llvm::orc::MaterializationResponsibility& r) -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+          auto statistics = get_module_statistics(r.getTargetJITDylib());
+          auto err = tsm.withModuleDo([&](llvm::Module& module) -> llvm::Error {
+            auto start = std::chrono::steady_clock::now();
+            if (auto err = optimize(module)) { return err; }
+            if (statistics) {
+              statistics->add_time(detail::compile_phase::optimization, std::chrono::steady_clock::now() - start);
+              // code generation measures its time from here.
+              pending_phases_.start(&module, std::move(statistics));
+            }
+            return llvm::Error::success();
+          });
+          if (err) { return std::move(err); }
+          return std::move(tsm);
+        });
+  }
+
+  llvm::Error optimize(llvm::Module& module) {
+    auto level = detail::get_optimization_level(module, optimization_level_);
+    if (level == optimization_level::O0) { return llvm::Error::success(); }
+
+    // target machines are not thread-safe, each module gets its own.
+    auto tmb = target_machine_builder_;
+    tmb.setCodeGenOptLevel(detail::get_codegen_level(level));
+    auto tm = tmb.createTargetMachine();
+    if (!tm) { return tm.takeError(); }
+
+    detail::optimize_module(module, level, **tm);
+    return llvm::Error::success();
+  }
+
+  // each module lives in its own JITDylib, so that modules may define functions with the same names. the JITDylib
+  // links against the main one, which holds the symbols shared by all modules.
+  llvm::orc::JITDylib& acquire_dylib(std::string const& name) {
+    {
+      auto lock = std::lock_guard(free_dylibs_mutex_);
+      if (!free_dylibs_.empty()) {
+        auto dylib = free_dylibs_.back();
+        free_dylibs_.pop_back();
+        return *dylib;
+      }
+    }
+    auto& dylib = cantFail(lljit_->createJITDylib(fmt::format("{}_{}", name, detail::id_counter++)));
+    dylib.setLinkOrder({{&lljit_->getMainJITDylib(), llvm::orc::JITDylibLookupFlags::MatchAllSymbols}});
+    return dylib;
+  }
+
+  // ORC does not allow removing JITDylibs, once their contents are removed they are kept for reuse.
+  void release_dylib(llvm::orc::JITDylib& dylib) {
+    set_module_statistics(dylib, nullptr);
+    if (lazy_) {
+      // the compile-on-demand layer defines the function bodies in a JITDylib of its own, outside of the resource
+      // tracker of the module, and keeps per-JITDylib state that is never released. the bodies are freed here, but
+      // the JITDylib is not reused, so that a new module with the same names does not collide with that state.
+      if (auto impl = lljit_->getExecutionSession().getJITDylibByName(get_impl_dylib_name(dylib))) {
+        cantFail(impl->clear());
+      }
+      return;
+    }
+    auto lock = std::lock_guard(free_dylibs_mutex_);
+    free_dylibs_.push_back(&dylib);
+  }
+
+  // returns the name of a stub for a function of a tiered module. its pointer is set once the baseline code is ready.
+  std::string acquire_stub() {
+    {
+      auto lock = std::lock_guard(free_stubs_mutex_);
+      if (!free_stubs_.empty()) {
+        auto name = std::move(free_stubs_.back());
+        free_stubs_.pop_back();
+        return name;
+      }
+    }
+    auto name = fmt::format("codegen.stub{}", detail::id_counter++);
+    cantFail(stubs_->createStub(name, 0, llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable));
+    return name;
+  }
+
+  void release_stub(std::string name) {
+    auto lock = std::lock_guard(free_stubs_mutex_);
+    free_stubs_.emplace_back(std::move(name));
+  }
+
+  void set_module_statistics(llvm::orc::JITDylib const& dylib, std::shared_ptr<detail::module_statistics> statistics) {
+    auto lock = std::lock_guard(module_statistics_mutex_);
+    if (statistics) {
+      module_statistics_[&dylib] = std::move(statistics);
+    } else {
+      module_statistics_.erase(&dylib);
+    }
+  }
+
+  // code of lazy modules is compiled in the JITDylib of the compile-on-demand layer, it is attributed to the module.
+  std::shared_ptr<detail::module_statistics> get_module_statistics(llvm::orc::JITDylib const& dylib) {
+    auto owner = &dylib;
+    if (lazy_) {
+      auto name = llvm::StringRef(dylib.getName());
+      if (name.consume_back(".impl")) {
+        if (auto module_dylib = lljit_->getExecutionSession().getJITDylibByName(name)) { owner = module_dylib; }
+      }
+    }
+    auto lock = std::lock_guard(module_statistics_mutex_);
+    auto it = module_statistics_.find(owner);
+    return it != module_statistics_.end() ? it->second : nullptr;
   }
 
+  static std::string get_impl_dylib_name(llvm::orc::JITDylib const& dylib) { return dylib.getName() + ".impl"; }
+
 public:
-  compiler_context(std::string context_name = "codegen")
-      : compiler_context(context_name, cantFail(llvm::orc::JITTargetMachineBuilder::detectHost())) {}
+  compiler_context(std::string context_name = "codegen", optimization_level level = optimization_level::O0)
+      : compiler_context(context_name, compiler_options{.level = level}) {}
+
+  compiler_context(std::string context_name, compiler_options const& options)
+      : compiler_context(context_name, detail::get_target_machine_builder(options.target), options) {}
 
   compiler_context(compiler_context const&) = delete;
   compiler_context(compiler_context&&) = delete;
@@ -103,12 +493,68 @@ public:
         {{lljit_->mangleAndIntern(std::move(name)), llvm::JITEvaluatedSymbol::fromPointer(address)}})));
   }
 
-  llvm::Error compileModule(std::unique_ptr<llvm::Module> module, std::unique_ptr<llvm::LLVMContext> context) {
-    return lljit_->addIRModule(llvm::orc::ThreadSafeModule(std::move(module), std::move(context)));
+  llvm::Error compileModule(llvm::orc::ResourceTrackerSP tracker, std::unique_ptr<llvm::Module> module,
+                            std::unique_ptr<llvm::LLVMContext> context) {
+    if (lazy_) {
+      // LLLazyJIT::addLazyIRModule() does not take a resource tracker, the module goes straight to its
+      // compile-on-demand layer instead.
+      if (module->getDataLayout().isDefault()) { module->setDataLayout(lljit_->getDataLayout()); }
+      return static_cast<llvm::orc::LLLazyJIT&>(*lljit_).getCompileOnDemandLayer().add(
+          std::move(tracker), llvm::orc::ThreadSafeModule(std::move(module), std::move(context)));
+    }
+    return compileModule(std::move(tracker), llvm::orc::ThreadSafeModule(std::move(module), std::move(context)));
+  }
+
+  llvm::Error compileModule(llvm::orc::ResourceTrackerSP tracker, llvm::orc::ThreadSafeModule module) {
+    return lljit_->addIRModule(std::move(tracker), std::move(module));
   }
 
+  // links the functions of a bitcode file, e.g. one built with codegen_add_runtime_bitcode(), into all modules built
+  // afterwards, wherever they are called. declare them with module_builder::declare_runtime_function(), or with
+  // declare_external_function() to keep the host function as the definition of modules built without the runtime.
+  void add_runtime_library(std::filesystem::path const& path) { runtime_.add(path); }
+
+  // like above, but takes bitcode embedded in the application. the buffer is copied.
+  void add_runtime_library_bitcode(llvm::MemoryBufferRef bitcode) { runtime_.add(bitcode); }
+
   const std::string& name() { return name_; }
 
+  optimization_level get_optimization_level() const { return optimization_level_; }
+
+  std::string const& target_cpu() const { return target_machine_builder_.getCPU(); }
+
+  std::string target_features() const { return target_machine_builder_.getFeatures().getString(); }
+
+  bool is_lazy() const { return lazy_; }
+
+  bool is_tiered() const { return tier_up_threshold_ != 0; }
+
+  // number of functions that have been recompiled at O3 and are now called through their optimized code.
+  uint64_t tier_ups() const { return tier_ups_.load(); }
+
+  // stores compiled objects in the given directory and reuses them for modules with identical IR.
+  void enable_object_cache(std::filesystem::path const& directory) { object_cache_.set_directory(directory); }
+
+  // reuses already compiled code for modules that differ from a previously built one only in names.
+  void enable_module_cache(size_t capacity) { module_cache_.set_capacity(capacity); }
+
+  module_cache const& get_module_cache() const { return module_cache_; }
+
+  // shares the code of modules with all processes using the same cache file, see shared_code_cache. the capacity is
+  // reserved in the address space of every process, it is fixed by the process that creates the file. lazy and tiered
+  // contexts do not use the cache.
+  void enable_shared_code_cache(std::filesystem::path const& path, size_t capacity = size_t(256) << 20) {
+    shared_code_cache_.open(path, capacity);
+  }
+
+  shared_code_cache const& get_shared_code_cache() const { return shared_code_cache_; }
+
+  // compilation statistics aggregated over all modules built by this context.
+  compile_counters statistics() const { return statistics_.get(); }
+
+  // memory currently held by the arenas. empty unless arena memory is enabled.
+  memory_usage code_memory() const { return arena_ ? arena_->usage() : memory_usage{}; }
+
   template<typename... ElementTypes> void add_aligned_struct_type(std::string const& name) {
     // build type;
     llvm::StructType* llvm_type = nullptr;
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <llvm/ExecutionEngine/RuntimeDyld.h>
+#include <llvm/Support/Memory.h>
+
+namespace codegen {
+
+struct memory_usage {
+  // memory mapped for the arenas.
+  size_t mapped = 0;
+  // memory handed out to loaded objects, rounded up to whole pages.
+  size_t allocated = 0;
+};
+
+namespace detail {
+
+inline size_t page_size() {
+  static auto const size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+inline size_t align_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// large mappings from which the memory managers of all objects of a compiler_context carve whole pages. code arenas
+// are mapped twice from the same memfd: a writable view the linker writes to and an executable view the code runs
+// from. the protection of neither view ever changes, so that the kernel can keep them on huge pages.
+class arena_allocator {
+public:
+  enum class kind { code, data };
+
+  struct block {
+    std::byte* address = nullptr;
+    // where the code is executed from. the same as address for data.
+    std::byte* exec_address = nullptr;
+    size_t size = 0;
+  };
+
+private:
+  static constexpr size_t huge_page_size = 2 << 20;
+
+  struct arena {
+    kind type;
+    std::byte* address;
+    std::byte* exec_address;
+    size_t size;
+    size_t free_bytes;
+    // free ranges by address, adjacent ranges are always merged.
+    std::map<std::byte*, size_t> free;
+  };
+
+  size_t arena_size_;
+  bool huge_pages_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<arena>> arenas_;
+  memory_usage usage_;
+
+public:
+  // code arenas need memfd_create().
+#if __linux__
+  static constexpr bool supported = true;
+#else
+  static constexpr bool supported = false;
+#endif
+
+  arena_allocator(size_t arena_size, bool huge_pages)
+      : arena_size_(align_up(arena_size, huge_pages ? huge_page_size : page_size())), huge_pages_(huge_pages) {}
+
+  ~arena_allocator() {
+    for (auto& a : arenas_) { unmap(*a); }
+  }
+
+  arena_allocator(arena_allocator const&) = delete;
+  arena_allocator& operator=(arena_allocator const&) = delete;
+
+  // returns an empty block if the memory cannot be mapped.
+  block allocate(kind type, size_t size) {
+    size = align_up(size, page_size());
+    auto lock = std::lock_guard(mutex_);
+    for (auto& a : arenas_) {
+      if (a->type != type || a->free_bytes < size) { continue; }
+      for (auto it = a->free.begin(); it != a->free.end(); ++it) {
+        if (it->second < size) { continue; }
+        auto address = it->first;
+        auto remaining = it->second - size;
+        a->free.erase(it);
+        if (remaining) { a->free.emplace(address + size, remaining); }
+        a->free_bytes -= size;
+        usage_.allocated += size;
+        return block{address, a->exec_address + (address - a->address), size};
+      }
+    }
+
+    auto a = map(type, std::max(arena_size_, align_up(size, arena_size_)));
+    if (!a) { return {}; }
+    auto address = a->address;
+    if (a->size > size) { a->free.emplace(address + size, a->size - size); }
+    a->free_bytes -= size;
+    usage_.mapped += a->size;
+    usage_.allocated += size;
+    auto b = block{address, a->exec_address, size};
+    arenas_.emplace_back(std::move(a));
+    return b;
+  }
+
+  // arenas left without any allocations are unmapped.
+  void release(block b) {
+    auto lock = std::lock_guard(mutex_);
+    auto it = std::find_if(arenas_.begin(), arenas_.end(), [&](auto& a) {
+      return b.address >= a->address && b.address < a->address + a->size;
+    });
+    assert(it != arenas_.end());
+    auto& a = **it;
+    if (a.type == kind::data) { mprotect(b.address, b.size, PROT_READ | PROT_WRITE); }
+
+    auto range = a.free.emplace(b.address, b.size).first;
+    if (auto next = std::next(range); next != a.free.end() && range->first + range->second == next->first) {
+      range->second += next->second;
+      a.free.erase(next);
+    }
+    if (range != a.free.begin()) {
+      if (auto prev = std::prev(range); prev->first + prev->second == range->first) {
+        prev->second += range->second;
+        a.free.erase(range);
+      }
+    }
+    a.free_bytes += b.size;
+    usage_.allocated -= b.size;
+
+    if (a.free_bytes == a.size) {
+      usage_.mapped -= a.size;
+      unmap(a);
+      arenas_.erase(it);
+    }
+  }
+
+  memory_usage usage() const {
+    auto lock = std::lock_guard(mutex_);
+    return usage_;
+  }
+
+private:
+  // huge pages are used only if the mapping is aligned to them.
+  std::byte* map_aligned(size_t size, int prot, int flags, int fd) {
+    auto alignment = huge_pages_ ? huge_page_size : page_size();
+    auto reserved = mmap(nullptr, size + alignment, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) { return nullptr; }
+    auto begin = static_cast<std::byte*>(reserved);
+    auto aligned = reinterpret_cast<std::byte*>(align_up(reinterpret_cast<uintptr_t>(begin), alignment));
+    if (aligned != begin) { munmap(begin, aligned - begin); }
+    if (auto tail = begin + size + alignment - (aligned + size)) { munmap(aligned + size, tail); }
+
+    auto address = mmap(aligned, size, prot, flags | MAP_FIXED, fd, 0);
+    if (address == MAP_FAILED) {
+      munmap(aligned, size);
+      return nullptr;
+    }
+#if __linux__
+    if (huge_pages_) { madvise(address, size, MADV_HUGEPAGE); }
+#endif
+    return static_cast<std::byte*>(address);
+  }
+
+  std::unique_ptr<arena> map(kind type, size_t size) {
+    auto a = std::make_unique<arena>(arena{type, nullptr, nullptr, size, size, {}});
+    if (type == kind::data) {
+      a->address = map_aligned(size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1);
+      a->exec_address = a->address;
+      return a->address ? std::move(a) : nullptr;
+    }
+
+#if __linux__
+    auto fd = memfd_create("codegen", MFD_CLOEXEC);
+    if (fd < 0) { return nullptr; }
+    if (ftruncate(fd, size) == 0) {
+      a->address = map_aligned(size, PROT_READ | PROT_WRITE, MAP_SHARED, fd);
+      a->exec_address = a->address ? map_aligned(size, PROT_READ | PROT_EXEC, MAP_SHARED, fd) : nullptr;
+    }
+    close(fd);
+    if (!a->exec_address) {
+      if (a->address) { munmap(a->address, size); }
+      return nullptr;
+    }
+    return a;
+#else
+    return nullptr;
+#endif
+  }
+
+  static void unmap(arena& a) {
+    munmap(a.address, a.size);
+    if (a.exec_address != a.address) { munmap(a.exec_address, a.size); }
+  }
+};
+
+// memory manager of a single object, allocating its sections from the arenas. all sections of the same kind are
+// placed next to each other in as few blocks as possible.
+class arena_memory_manager : public llvm::RTDyldMemoryManager {
+  struct pool {
+    arena_allocator::kind type;
+    arena_allocator::block current{};
+    size_t used = 0;
+  };
+
+  arena_allocator* allocator_;
+  pool code_{arena_allocator::kind::code};
+  pool read_only_data_{arena_allocator::kind::data};
+  pool data_{arena_allocator::kind::data};
+
+  std::vector<arena_allocator::block> blocks_;
+  std::vector<arena_allocator::block> read_only_blocks_;
+  // code sections, with their address in the executable view.
+  std::vector<arena_allocator::block> code_sections_;
+
+public:
+  explicit arena_memory_manager(arena_allocator& allocator) : allocator_(&allocator) {}
+
+  ~arena_memory_manager() override {
+    for (auto& b : blocks_) { allocator_->release(b); }
+  }
+
+  using llvm::RTDyldMemoryManager::notifyObjectLoaded;
+
+  bool needsToReserveAllocationSpace() override { return true; }
+
+  void reserveAllocationSpace(uintptr_t code_size, uint32_t code_alignment, uintptr_t read_only_size,
+                              uint32_t read_only_alignment, uintptr_t data_size, uint32_t data_alignment) override {
+    reserve(code_, code_size + code_alignment);
+    reserve(read_only_data_, read_only_size + read_only_alignment);
+    reserve(data_, data_size + data_alignment);
+  }
+
+  uint8_t* allocateCodeSection(uintptr_t size, unsigned alignment, unsigned, llvm::StringRef) override {
+    auto address = allocate(code_, size, alignment);
+    if (address) {
+      auto offset = address - code_.current.address;
+      code_sections_.push_back({address, code_.current.exec_address + offset, size});
+    }
+    return reinterpret_cast<uint8_t*>(address);
+  }
+
+  uint8_t* allocateDataSection(uintptr_t size, unsigned alignment, unsigned, llvm::StringRef,
+                               bool read_only) override {
+    return reinterpret_cast<uint8_t*>(allocate(read_only ? read_only_data_ : data_, size, alignment));
+  }
+
+  // relocations are resolved against the executable view of the code.
+  void notifyObjectLoaded(llvm::RuntimeDyld& dyld, llvm::object::ObjectFile const&) override {
+    for (auto& section : code_sections_) {
+      dyld.mapSectionAddress(section.address, reinterpret_cast<uint64_t>(section.exec_address));
+    }
+  }
+
+  bool finalizeMemory(std::string* error) override {
+    for (auto& b : read_only_blocks_) {
+      if (mprotect(b.address, b.size, PROT_READ)) {
+        if (error) { *error = "failed to protect read-only data"; }
+        return true;
+      }
+    }
+    for (auto& section : code_sections_) {
+      llvm::sys::Memory::InvalidateInstructionCache(section.exec_address, section.size);
+    }
+    return false;
+  }
+
+private:
+  void reserve(pool& p, size_t size) {
+    if (size) { new_block(p, size); }
+  }
+
+  bool new_block(pool& p, size_t size) {
+    auto b = allocator_->allocate(p.type, size);
+    if (!b.address) { return false; }
+    blocks_.push_back(b);
+    if (&p == &read_only_data_) { read_only_blocks_.push_back(b); }
+    p.current = b;
+    p.used = 0;
+    return true;
+  }
+
+  std::byte* allocate(pool& p, size_t size, unsigned alignment) {
+    alignment = std::max(alignment, 16u);
+    auto offset = align_up(p.used, alignment);
+    if (!p.current.address || offset + size > p.current.size) {
+      if (!new_block(p, size + alignment)) { return nullptr; }
+      offset = 0;
+    }
+    p.used = offset + size;
+    return p.current.address + offset;
+  }
+};
+
+} // namespace detail
+
+} // namespace codegen
@@ -22,28 +22,254 @@
 
 #pragma once
 
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "aot.hpp"
+#include "compiler_context.hpp"
+
 namespace codegen {
 
 template<typename ReturnType, typename... Arguments> class function_ref;
 
+class module;
+inline module load_bitcode(compiler_context& c, std::filesystem::path const& path);
+
+namespace detail {
+
+template<typename> class function_builder;
+
+// the JITDylib and resource tracker owning the code of a single module. destroying it frees the code memory of the
+// module and returns the JITDylib to the compiler context. the compiler context must outlive all its modules.
+class module_resources : public std::enable_shared_from_this<module_resources> {
+  compiler_context* compiler_;
+  llvm::orc::JITDylib* dylib_;
+  llvm::orc::ResourceTrackerSP tracker_;
+  std::shared_ptr<module_statistics> statistics_;
+
+  // uninstrumented IR of a tiered module, optimized functions are extracted from it.
+  std::optional<llvm::orc::ThreadSafeModule> original_module_;
+  std::vector<std::unique_ptr<tiered_function>> tiered_functions_;
+
+public:
+  module_resources(compiler_context& c, std::string const& name)
+      : compiler_(&c), dylib_(&c.acquire_dylib(name)), tracker_(dylib_->createResourceTracker()),
+        statistics_(std::make_shared<module_statistics>(c.statistics_)) {
+    c.set_module_statistics(*dylib_, statistics_);
+  }
+
+  ~module_resources() {
+    cantFail(tracker_->remove());
+    for (auto& tf : tiered_functions_) { compiler_->release_stub(tf->stub_name); }
+    compiler_->release_dylib(*dylib_);
+  }
+
+  module_resources(module_resources const&) = delete;
+  module_resources(module_resources&&) = delete;
+
+  llvm::orc::ResourceTrackerSP const& tracker() const { return tracker_; }
+
+  module_statistics& statistics() { return *statistics_; }
+
+  void add_symbol(std::string const& name, void* address) {
+    cantFail(dylib_->define(llvm::orc::absoluteSymbols({{compiler_->lljit_->mangleAndIntern(name),
+                                                         llvm::JITEvaluatedSymbol::fromPointer(address)}}),
+                            tracker_));
+  }
+
+  // links an object compiled outside of the JIT, the linking phase ends when the JIT emits it.
+  void add_object(std::unique_ptr<llvm::MemoryBuffer> object) {
+    auto pending = std::make_unique<pending_object>(std::move(object), compiler_->pending_phases_);
+    compiler_->pending_phases_.start(pending.get(), statistics_);
+    throw_on_error(compiler_->lljit_->addObjectFile(tracker_, std::move(pending)));
+  }
+
+  // defines the symbols of a module whose code is not compiled by the JIT.
+  void add_symbols(std::vector<shared_symbol> const& symbols) {
+    auto& session = compiler_->lljit_->getExecutionSession();
+    auto map = llvm::orc::SymbolMap{};
+    for (auto& s : symbols) {
+      map[session.intern(s.name)] =
+          llvm::JITEvaluatedSymbol(s.address, llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+    }
+    throw_on_error(dylib_->define(llvm::orc::absoluteSymbols(std::move(map)), tracker_));
+  }
+
+  // resolves an external symbol of the module, by its mangled name, the way the JIT would. returns 0 if there is no
+  // such symbol.
+  llvm::JITTargetAddress resolve(std::string const& name) const {
+    auto& session = compiler_->lljit_->getExecutionSession();
+    auto search_order = llvm::orc::makeJITDylibSearchOrder({dylib_, &compiler_->lljit_->getMainJITDylib()},
+                                                           llvm::orc::JITDylibLookupFlags::MatchAllSymbols);
+    auto symbol = session.lookup(search_order, session.intern(name));
+    if (!symbol) {
+      llvm::consumeError(symbol.takeError());
+      return 0;
+    }
+    return symbol->getAddress();
+  }
+
+  // compiles the given functions, on the compile threads of the context if it has any, and calls on_complete once
+  // they are ready.
+  void compile(std::vector<std::string> const& names, llvm::unique_function<void(llvm::Error)> on_complete) {
+    auto symbols = llvm::orc::SymbolLookupSet{};
+    for (auto& name : names) { symbols.add(compiler_->lljit_->mangleAndIntern(name)); }
+    compiler_->lljit_->getExecutionSession().lookup(
+        llvm::orc::LookupKind::Static, llvm::orc::makeJITDylibSearchOrder(dylib_), std::move(symbols),
+        llvm::orc::SymbolState::Ready,
+        [on_complete = std::move(on_complete)](llvm::Expected<llvm::orc::SymbolMap> result) mutable {
+          on_complete(result.takeError());
+        },
+        llvm::orc::NoDependenciesToRegister);
+  }
+
+  // compiles the baseline code of all functions of the module eagerly and binds their names to stubs. the stubs are
+  // updated when the optimized code of a hot function becomes ready.
+  void compile_tiered(llvm::orc::ThreadSafeModule tsm) {
+    auto& stubs = *compiler_->stubs_;
+    auto stub_symbols = llvm::orc::SymbolMap{};
+
+    tsm.withModuleDo([&](llvm::Module& module) {
+      externalize_local_symbols(module);
+      original_module_.emplace(llvm::CloneModule(module), tsm.getContext());
+
+      for (auto& fn : module) {
+        if (fn.isDeclaration()) { continue; }
+        auto& tf = *tiered_functions_.emplace_back(std::make_unique<tiered_function>());
+        tf.name = fn.getName().str();
+        tf.stub_name = compiler_->acquire_stub();
+        tf.on_hot = [self = weak_from_this(), fn = &tf, threads = compiler_->tier_up_threads_.get()] {
+          threads->async([self, fn] {
+            if (auto resources = self.lock()) { resources->tier_up(*fn); }
+          });
+        };
+
+        stub_symbols[compiler_->lljit_->mangleAndIntern(tf.name)] =
+            llvm::JITEvaluatedSymbol(stubs.findStub(tf.stub_name, true).getAddress(),
+                                     llvm::JITSymbolFlags::Exported | llvm::JITSymbolFlags::Callable);
+      }
+
+      instrument_for_tiering(module, tiered_functions_, compiler_->tier_up_threshold_);
+    });
+
+    throw_on_error(dylib_->define(llvm::orc::absoluteSymbols(std::move(stub_symbols)), tracker_));
+    throw_on_error(compiler_->compileModule(tracker_, std::move(tsm)));
+    for (auto& tf : tiered_functions_) {
+      auto baseline = compiler_->lljit_->lookup(*dylib_, baseline_name(tf->name));
+      if (!baseline) { throw llvm_error(baseline.takeError()); }
+      throw_on_error(stubs.updatePointer(tf->stub_name, baseline->getAddress()));
+    }
+  }
+
+  llvm::JITTargetAddress lookup(std::string const& name) const { return lookup(std::vector<std::string>{name})[0]; }
+
+  // resolves all symbols with a single lookup, so that the code they need is materialized at once.
+  std::vector<llvm::JITTargetAddress> lookup(std::vector<std::string> const& names) const {
+    auto start = std::chrono::steady_clock::now();
+    auto symbols = llvm::orc::SymbolLookupSet{};
+    auto interned = std::vector<llvm::orc::SymbolStringPtr>{};
+    for (auto& name : names) {
+      interned.emplace_back(compiler_->lljit_->mangleAndIntern(name));
+      symbols.add(interned.back());
+    }
+    auto result = compiler_->lljit_->getExecutionSession().lookup(
+        llvm::orc::makeJITDylibSearchOrder(dylib_, llvm::orc::JITDylibLookupFlags::MatchAllSymbols), symbols);
+    if (!result) { throw llvm_error(result.takeError()); }
+
+    auto addresses = std::vector<llvm::JITTargetAddress>{};
+    for (auto& symbol : interned) { addresses.emplace_back((*result)[symbol].getAddress()); }
+    statistics_->add_time(compile_phase::symbol_lookup, std::chrono::steady_clock::now() - start);
+    return addresses;
+  }
+
+private:
+  // runs on the tier-up thread. if anything goes wrong the function simply stays at the baseline tier.
+  void tier_up(tiered_function& tf) {
+    auto module =
+        original_module_->withModuleDo([&](llvm::Module& m) { return extract_for_tier_up(m, tf.name); });
+    auto err = compiler_->compileModule(tracker_, llvm::orc::ThreadSafeModule(std::move(module),
+                                                                              original_module_->getContext()));
+    if (err) {
+      llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "codegen: tier-up failed: ");
+      return;
+    }
+    auto optimized = compiler_->lljit_->lookup(*dylib_, optimized_name(tf.name));
+    if (!optimized) {
+      llvm::logAllUnhandledErrors(optimized.takeError(), llvm::errs(), "codegen: tier-up failed: ");
+      return;
+    }
+    cantFail(compiler_->stubs_->updatePointer(tf.stub_name, optimized->getAddress()));
+    compiler_->tier_ups_++;
+  }
+};
+
+} // namespace detail
+
 class module {
-  std::unique_ptr<llvm::orc::LLJIT> lljit_;
-  llvm::orc::MangleAndInterner mangle_;
+  std::shared_ptr<detail::module_resources> resources_;
+
+  // maps names of functions of this module to the names they were compiled with, if the code is shared with an
+  // identical module from the module cache.
+  std::unordered_map<std::string, std::string> function_names_;
+
+  // signatures of the functions of a module loaded from bitcode, checked when their addresses are looked up by name.
+  std::unordered_map<std::string, detail::function_signature> signatures_;
 
 private:
-  module(std::unique_ptr<llvm::orc::LLJIT> lljit, llvm::orc::MangleAndInterner const& mangle)
-      : lljit_(std::move(lljit)), mangle_(std::move(mangle)) {}
+  module(std::shared_ptr<detail::module_resources> resources,
+         std::unordered_map<std::string, std::string> function_names = {},
+         std::unordered_map<std::string, detail::function_signature> signatures = {})
+      : resources_(std::move(resources)), function_names_(std::move(function_names)),
+        signatures_(std::move(signatures)) {}
 
   friend class module_builder;
+  friend module load_bitcode(compiler_context& c, std::filesystem::path const& path);
 
 public:
   module(module const&) = delete;
-  module(module&&) = delete;
+  module(module&&) = default;
 
   template<typename ReturnType, typename... Arguments>
   auto get_address(function_ref<ReturnType, Arguments...> const& fn) {
-    auto entry_pointer = cantFail(lljit_->lookup(fn.name()));
-    return llvm::jitTargetAddressToFunction<ReturnType (*)(Arguments...)>(entry_pointer.getAddress());
+    auto address = resources_->lookup(compiled_name(fn.name()));
+    return llvm::jitTargetAddressToFunction<ReturnType (*)(Arguments...)>(address);
+  }
+
+  // looks up the addresses of all given functions at once, e.g. auto [a, b] = module.get_addresses(fn_a, fn_b).
+  template<typename... FunctionRefs> auto get_addresses(FunctionRefs const&... fns) {
+    auto addresses = resources_->lookup(std::vector<std::string>{compiled_name(fns.name())...});
+    return [&]<size_t... Idx>(std::index_sequence<Idx...>) {
+      return std::tuple{llvm::jitTargetAddressToFunction<typename FunctionRefs::pointer_type>(addresses[Idx])...};
+    }(std::index_sequence_for<FunctionRefs...>{});
+  }
+
+  // looks up a function of a module loaded from bitcode, e.g. get_address<int32_t(int32_t)>("fn"). throws if the
+  // module does not define a function with that name and signature.
+  template<typename FunctionType> auto get_address(std::string const& name) {
+    auto it = signatures_.find(name);
+    auto expected = detail::function_builder<FunctionType>::signature(name);
+    if (it == signatures_.end() || it->second.return_type != expected.return_type ||
+        it->second.arguments != expected.arguments) {
+      throw llvm_error(llvm::createStringError(llvm::inconvertibleErrorCode(), "no function %s",
+                                               detail::cxx_declaration(expected).c_str()));
+    }
+    return llvm::jitTargetAddressToFunction<FunctionType*>(resources_->lookup(name));
+  }
+
+  // modules served from the module cache report the compilation of the module they share the code with.
+  compile_report report() const { return resources_->statistics().get(); }
+
+private:
+  std::string const& compiled_name(std::string const& name) const {
+    auto it = function_names_.find(name);
+    return it != function_names_.end() ? it->second : name;
   }
 };
 
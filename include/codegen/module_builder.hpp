@@ -22,9 +22,16 @@
 
 #pragma once
 
+#include <chrono>
 #include <fstream>
+#include <functional>
+#include <future>
+#include <map>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 #include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/DebugInfoMetadata.h>
@@ -38,6 +45,8 @@
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 
+#include "aot.hpp"
+#include "bitcode.hpp"
 #include "compiler_context.hpp"
 #include "module.hpp"
 
@@ -51,6 +60,8 @@ template<typename ReturnType, typename... Arguments> class function_ref {
   llvm::Function* function_;
 
 public:
+  using pointer_type = ReturnType (*)(Arguments...);
+
   explicit function_ref(std::string const& name, llvm::Function* fn) : name_(name), function_(fn) {}
 
   void set_function_attribute(std::pair<llvm::StringRef, llvm::StringRef> attribute_set) {
@@ -70,6 +81,12 @@ class module_builder {
   llvm::IRBuilder<> ir_builder_;
   std::unique_ptr<llvm::Module> module_;
   llvm::Function* function_;
+  std::optional<optimization_level> optimization_level_;
+  std::shared_ptr<detail::module_resources> resources_;
+  std::chrono::steady_clock::time_point created_ = std::chrono::steady_clock::now();
+  std::vector<detail::function_signature> signatures_;
+  // symbols bound only for this module, they are a part of its module cache key.
+  std::map<std::string, void*> external_symbols_;
 
   static inline thread_local std::unique_ptr<module_builder> current_builder_;
 
@@ -82,37 +99,54 @@ public:
     std::filesystem::path source_file_;
     llvm::Module& module_;
     llvm::DIBuilder dbg_builder_;
-    llvm::DIFile* dbg_file_;
+    llvm::DIFile* dbg_file_ = nullptr;
     std::stack<llvm::DIScope*> dbg_scopes_;
 
+    // when disabled neither the pseudo-c source nor any debug metadata is generated.
+    bool enabled_;
+
   public:
-    source_code_generator(llvm::Module& module, std::filesystem::path source_file)
-        : source_file_(source_file), module_(module), dbg_builder_(module_),
-          dbg_file_(dbg_builder_.createFile(source_file.string(), source_file.parent_path().string())),
-          dbg_scopes_({dbg_file_}) {
+    source_code_generator(llvm::Module& module, std::filesystem::path source_file, bool enabled = true)
+        : source_file_(source_file), module_(module), dbg_builder_(module_), enabled_(enabled) {
+      if (!enabled_) { return; }
+      dbg_file_ = dbg_builder_.createFile(source_file.string(), source_file.parent_path().string());
+      dbg_scopes_.push(dbg_file_);
       dbg_builder_.createCompileUnit(llvm::dwarf::DW_LANG_C_plus_plus, dbg_file_, "codegen", true, "", 0);
     }
 
+    bool enabled() const { return enabled_; }
+
     llvm::DIBuilder& debug_builder() { return dbg_builder_; }
     llvm::DIFile* debug_file() { return dbg_file_; }
     llvm::DIScope* debug_scope() { return dbg_scopes_.top(); }
     void create_debug_scope(llvm::DIScope* new_scope) { dbg_scopes_.push(new_scope); }
 
     llvm::DILocation* get_debug_location(unsigned line, unsigned col = 1) {
+      if (!enabled_) { return nullptr; }
       return llvm::DILocation::get(module_.getContext(), line, col, debug_scope());
     }
 
     unsigned add_line(std::string const& line) {
+      if (!enabled_) { return 0; }
       source_code_ << std::string(indent_, ' ') << line << "\n";
       return line_no_++;
     }
 
+    // the line is only formatted if source code generation is enabled.
+    template<typename LineGenerator, typename = std::enable_if_t<std::is_invocable_r_v<std::string, LineGenerator>>>
+    unsigned add_line(LineGenerator&& make_line) {
+      if (!enabled_) { return 0; }
+      return add_line(std::string(make_line()));
+    }
+
     void enter_scope() {
+      if (!enabled_) { return; }
       indent_ += 4;
       dbg_scopes_.emplace(dbg_builder_.createLexicalBlock(debug_scope(), dbg_file_, current_line(), 1));
     }
 
     void leave_scope() {
+      if (!enabled_) { return; }
       indent_ -= 4;
       dbg_scopes_.pop();
     }
@@ -122,7 +156,9 @@ public:
 
     llvm::DISubprogram* jit_enter_function_scope(std::string const& function_name, llvm::FunctionType* func_type);
 
-    void leave_function_scope() { dbg_scopes_.pop(); }
+    void leave_function_scope() {
+      if (enabled_) { dbg_scopes_.pop(); }
+    }
 
     unsigned current_line() const { return line_no_; }
 
@@ -154,9 +190,11 @@ public:
   module_builder(compiler_context& c, std::string const& name, bool enable_debug_codegen = true)
       : compiler_(&c), context_(std::make_unique<llvm::LLVMContext>()), ir_builder_(*context_),
         module_(std::make_unique<llvm::Module>(name, *context_)), function_(nullptr),
+        resources_(std::make_shared<detail::module_resources>(c, name)),
         source_code_(*module_,
-                     std::filesystem::temp_directory_path() / ("cg_" + c.name()) / (name + ".c")) {
-    std::filesystem::create_directories(source_code_.source_file().parent_path());
+                     std::filesystem::temp_directory_path() / ("cg_" + c.name()) / (name + ".c"),
+                     enable_debug_codegen) {
+    if (enable_debug_codegen) { std::filesystem::create_directories(source_code_.source_file().parent_path()); }
 
     assert(module_builder::current_builder_.get() == nullptr);
     module_builder::register_current_builder(this);
@@ -168,6 +206,8 @@ public:
 
   llvm::DIBuilder& debug_builder() { return source_code_.debug_builder(); }
 
+  bool debug_info_enabled() const { return source_code_.enabled(); }
+
   llvm::DILocation* get_debug_location(unsigned line, unsigned col = 1) {
     return source_code_.get_debug_location(line, col);
   }
@@ -181,6 +221,9 @@ public:
 
   template<typename FunctionType> auto declare_external_function(std::string const& name, FunctionType* fn);
 
+  // declares a function defined by a runtime library, see compiler_context::add_runtime_library().
+  template<typename FunctionType> auto declare_runtime_function(std::string const& name);
+
   void dump_llvm_ir(llvm::raw_ostream& out) const { module_->print(out, nullptr); }
 
   llvm::IRBuilder<>& ir_builder() { return ir_builder_; }
@@ -189,24 +232,67 @@ public:
 
   llvm::Function*& current_function() { return function_; }
 
+  // overrides the optimization level of the compiler context for this module only.
+  void set_optimization_level(optimization_level level) { optimization_level_ = level; }
+
   auto begin_creating_function(std::string const& name, llvm::FunctionType* func_type);
   auto end_creating_function();
 
 
   [[nodiscard]] class module build() && {
-    {
-      auto ofs = std::ofstream(source_code_.source_file(), std::ios::trunc);
-      ofs << source_code_.get();
+    if (auto cached = finalize_and_compile()) { return std::move(*cached); }
+    return codegen::module{std::move(resources_)};
+  }
+
+  // compiles all functions of the module, on the compile threads of the compiler context if it has any. the future
+  // becomes ready once the code is ready, so looking up addresses in the module does not block. in lazy mode only
+  // the stubs are ready, function bodies are still compiled on their first call.
+  [[nodiscard]] std::future<class module> build_async() && {
+    auto promise = std::make_shared<std::promise<class module>>();
+    auto future = promise->get_future();
+
+    auto function_names = std::vector<std::string>{};
+    for (auto& fn : *module_) {
+      if (!fn.isDeclaration()) { function_names.emplace_back(fn.getName().str()); }
     }
-    source_code_.debug_builder().finalize();
 
-    if (compiler_->compileModule(std::move(module_), std::move(context_))) {
-      // TODO: clean up module builder.
-    } else {
-      // llvm_unreachable("Failed to compile"); // TODO: more error messages.
+    if (auto cached = finalize_and_compile()) {
+      promise->set_value(std::move(*cached));
+      return future;
     }
 
-    return codegen::module{std::move(compiler_->lljit_), compiler_->mangle_};
+    resources_->compile(function_names, [promise, resources = resources_](llvm::Error err) {
+      if (err) {
+        promise->set_exception(std::make_exception_ptr(llvm_error(std::move(err))));
+        return;
+      }
+      promise->set_value(codegen::module{std::move(resources)});
+    });
+    return future;
+  }
+
+  // compiles the module ahead of time into a relocatable object file, instead of handing it to the JIT. functions
+  // declared with declare_external_function() are left undefined, to be resolved when the object is linked.
+  void emit_object(std::filesystem::path const& path, aot_options const& options = {}) && {
+    detail::write_object(path, compile_ahead_of_time(options));
+  }
+
+  // like emit_object(), but writes a static library containing the object.
+  void emit_archive(std::filesystem::path const& path, aot_options const& options = {}) && {
+    auto member_name = path.stem().string() + ".o";
+    detail::write_archive(path, member_name, compile_ahead_of_time(options));
+  }
+
+  // saves the module, together with the signatures of its functions, as bitcode that load_bitcode() compiles without
+  // running the generator again.
+  void save_bitcode(std::filesystem::path const& path) && {
+    finalize();
+    if (optimization_level_) {
+      module_->addModuleFlag(llvm::Module::Override, detail::optimization_level_flag,
+                             static_cast<uint32_t>(*optimization_level_));
+    }
+    detail::add_signatures(*module_, signatures_);
+    detail::write_bitcode(path, *module_);
   }
 
   friend std::ostream& operator<<(std::ostream& os, module_builder const& mb) {
@@ -216,8 +302,114 @@ public:
   }
 
 private:
+  // writes the generated source file and completes the debug information that refers to it.
+  void finalize() {
+    if (!source_code_.enabled()) { return; }
+    {
+      auto ofs = std::ofstream(source_code_.source_file(), std::ios::trunc);
+      ofs << source_code_.get();
+    }
+    source_code_.debug_builder().finalize();
+  }
+
+  llvm::SmallVector<char, 0> compile_ahead_of_time(aot_options const& options) {
+    finalize();
+    if (options.header) { detail::write_header(*options.header, module_->getName().str(), signatures_); }
+    compiler_->runtime_.link_into(*module_, options.cpu, options.features);
+    auto level = options.level.value_or(optimization_level_.value_or(compiler_->get_optimization_level()));
+    return detail::compile_object(*module_, options, level);
+  }
+
+  // hands the module over to the JIT. returns the already compiled module instead, if the module cache has one.
+  std::optional<class module> finalize_and_compile() {
+    finalize();
+
+    // tiered modules are compiled at the levels of their tiers.
+    if (optimization_level_ && !compiler_->is_tiered()) {
+      module_->addModuleFlag(llvm::Module::Override, detail::optimization_level_flag,
+                             static_cast<uint32_t>(*optimization_level_));
+    }
+
+    auto key = std::optional<detail::structural_key>{};
+    if (compiler_->module_cache_.enabled()) {
+      key = detail::get_structural_key(*module_, external_symbols_);
+      if (auto entry = compiler_->module_cache_.find(key->ir)) {
+        auto function_names = std::unordered_map<std::string, std::string>{};
+        for (auto i = 0u; i < key->function_names.size(); i++) {
+          function_names.emplace(key->function_names[i], entry->function_names[i]);
+        }
+        return codegen::module{entry->resources, std::move(function_names)};
+      }
+    }
+
+    compiler_->runtime_.link_into(*module_, compiler_->target_cpu(), compiler_->target_features());
+
+    auto& statistics = resources_->statistics();
+    statistics.set_functions(detail::get_function_statistics(*module_));
+    statistics.add_time(detail::compile_phase::ir_generation, std::chrono::steady_clock::now() - created_);
 
-  void declare_external_symbol(std::string const& name, void* address) { compiler_->add_symbol(name, address); }
+    if (compiler_->shared_code_cache_.enabled() && !compiler_->is_lazy() && !compiler_->is_tiered() &&
+        detail::is_shareable(*module_)) {
+      compile_shared();
+    } else if (compiler_->is_tiered()) {
+      resources_->compile_tiered(
+          llvm::orc::ThreadSafeModule(std::move(module_), llvm::orc::ThreadSafeContext(std::move(context_))));
+    } else {
+      throw_on_error(compiler_->compileModule(resources_->tracker(), std::move(module_), std::move(context_)));
+    }
+
+    if (key) { compiler_->module_cache_.insert(std::move(key->ir), {resources_, std::move(key->function_names)}); }
+    return std::nullopt;
+  }
+
+  // takes the code of the module from the shared code cache, or compiles and links it into the cache. if the cache is
+  // full, the compiled object is handed to the JIT instead.
+  void compile_shared() {
+    auto& cache = compiler_->shared_code_cache_;
+    auto level = optimization_level_.value_or(compiler_->get_optimization_level());
+    auto key = cache.get_key(*module_, level);
+    auto resolve = std::function<uint64_t(std::string const&)>(
+        [resources = resources_.get()](std::string const& name) { return resources->resolve(name); });
+    if (auto symbols = cache.find(key, resolve)) {
+      resources_->add_symbols(*symbols);
+      return;
+    }
+
+    auto names = std::vector<std::string>{};
+    for (auto& fn : *module_) {
+      if (!fn.isDeclaration() && !fn.hasLocalLinkage()) {
+        names.emplace_back(*compiler_->lljit_->mangleAndIntern(fn.getName()));
+      }
+    }
+    // compiled as the JIT would, with the target, code model and relocation model of the context.
+    auto& statistics = resources_->statistics();
+    auto start = std::chrono::steady_clock::now();
+    if (module_->getDataLayout().isDefault()) { module_->setDataLayout(compiler_->data_layout_); }
+    throw_on_error(compiler_->optimize(*module_));
+    auto optimized = std::chrono::steady_clock::now();
+    statistics.add_time(detail::compile_phase::optimization, optimized - start);
+
+    auto tm = detail::create_target_machine(compiler_->target_machine_builder_, *module_,
+                                            compiler_->get_optimization_level());
+    if (!tm) { throw llvm_error(tm.takeError()); }
+    auto object = llvm::orc::SimpleCompiler(**tm)(*module_);
+    if (!object) { throw llvm_error(object.takeError()); }
+    auto compiled = std::chrono::steady_clock::now();
+    statistics.add_time(detail::compile_phase::code_generation, compiled - optimized);
+    statistics.add_object((*object)->getBufferSize());
+
+    if (auto symbols = cache.insert(key, (*object)->getMemBufferRef(), names, resolve)) {
+      statistics.add_time(detail::compile_phase::linking, std::chrono::steady_clock::now() - compiled);
+      resources_->add_symbols(*symbols);
+      return;
+    }
+    resources_->add_object(std::move(*object));
+  }
+
+  void declare_external_symbol(std::string const& name, void* address) {
+    resources_->add_symbol(name, address);
+    external_symbols_[name] = address;
+  }
 };
 
 } // namespace codegen
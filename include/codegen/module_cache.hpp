@@ -0,0 +1,150 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/IR/DebugInfo.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <fmt/format.h>
+
+namespace codegen {
+
+namespace detail {
+
+class module_resources;
+
+struct structural_key {
+  // canonical IR of the module with debug info, module name and all local and defined function names removed,
+  // followed by the addresses the module's own external symbols are bound to.
+  std::string ir;
+  // names of the functions defined in the module, in the order they appear in the canonical IR.
+  std::vector<std::string> function_names;
+};
+
+// external_symbols are the symbols bound only for this module, e.g. by declare_external_function(). modules with the
+// same IR that call different host functions must not share code.
+inline structural_key get_structural_key(llvm::Module const& module,
+                                         std::map<std::string, void*> const& external_symbols = {}) {
+  auto key = structural_key{};
+
+  auto clone = llvm::CloneModule(module);
+  llvm::StripDebugInfo(*clone);
+  clone->setModuleIdentifier("");
+  clone->setSourceFileName("");
+
+  auto idx = 0u;
+  for (auto& fn : *clone) {
+    for (auto& arg : fn.args()) { arg.setName(""); }
+    for (auto& bb : fn) {
+      bb.setName("");
+      for (auto& inst : bb) { inst.setName(""); }
+    }
+    // declarations keep their names, they identify the external symbols the module links against.
+    if (!fn.isDeclaration()) {
+      key.function_names.emplace_back(fn.getName().str());
+      fn.setName(fmt::format("codegen.fn{}", idx++));
+    }
+  }
+
+  auto os = llvm::raw_string_ostream(key.ir);
+  clone->print(os, nullptr);
+  for (auto& [name, address] : external_symbols) { os << "; external " << name << " = " << address << '\n'; }
+  os.flush();
+  return key;
+}
+
+} // namespace detail
+
+// in-memory cache of compiled modules owned by a compiler_context. modules are considered identical if their
+// canonical IR is equal, which ignores the module name, debug info and names of all values, including the names of
+// the functions defined by the module. the least recently used entry is evicted once the capacity is exceeded.
+class module_cache {
+public:
+  struct entry {
+    std::shared_ptr<detail::module_resources> resources;
+    std::vector<std::string> function_names;
+  };
+
+private:
+  using lru_list = std::list<std::pair<std::string, entry>>;
+
+  size_t capacity_ = 0;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+
+  lru_list entries_;
+  std::unordered_map<std::string_view, lru_list::iterator> index_;
+  mutable std::mutex mutex_;
+
+public:
+  void set_capacity(size_t capacity) {
+    auto lock = std::lock_guard(mutex_);
+    capacity_ = capacity;
+    evict();
+  }
+
+  bool enabled() const {
+    auto lock = std::lock_guard(mutex_);
+    return capacity_ != 0;
+  }
+
+  std::optional<entry> find(std::string const& ir) {
+    auto lock = std::lock_guard(mutex_);
+    auto it = index_.find(ir);
+    if (it == index_.end()) {
+      misses_++;
+      return std::nullopt;
+    }
+    hits_++;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->second;
+  }
+
+  void insert(std::string ir, entry e) {
+    auto lock = std::lock_guard(mutex_);
+    if (capacity_ == 0 || index_.count(ir)) { return; }
+    entries_.emplace_front(std::move(ir), std::move(e));
+    index_.emplace(entries_.front().first, entries_.begin());
+    evict();
+  }
+
+  size_t hits() const {
+    auto lock = std::lock_guard(mutex_);
+    return hits_;
+  }
+
+  size_t misses() const {
+    auto lock = std::lock_guard(mutex_);
+    return misses_;
+  }
+
+  size_t size() const {
+    auto lock = std::lock_guard(mutex_);
+    return entries_.size();
+  }
+
+  size_t capacity() const {
+    auto lock = std::lock_guard(mutex_);
+    return capacity_;
+  }
+
+private:
+  void evict() {
+    while (entries_.size() > capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+  }
+};
+
+} // namespace codegen
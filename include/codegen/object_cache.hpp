@@ -0,0 +1,101 @@
+#pragma once
+
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace codegen {
+
+// on-disk cache of compiled object files. entries are keyed by a hash of the final (optimized) IR together with the
+// target description, so that a cached object is never reused for a different triple, CPU, feature set or
+// optimization level.
+class object_cache : public llvm::ObjectCache {
+  std::optional<std::filesystem::path> directory_;
+  std::string target_id_;
+
+  // keys computed in getObject() are reused by notifyObjectCompiled() for the same module.
+  std::mutex mutex_;
+  std::unordered_map<llvm::Module const*, std::string> pending_keys_;
+
+public:
+  explicit object_cache(std::string target_id) : target_id_(std::move(target_id)) {}
+
+  void set_directory(std::filesystem::path directory) {
+    std::filesystem::create_directories(directory);
+    directory_ = std::move(directory);
+  }
+
+  bool enabled() const { return directory_.has_value(); }
+
+  std::unique_ptr<llvm::MemoryBuffer> getObject(llvm::Module const* module) override {
+    auto key = get_key(*module);
+    auto path = *directory_ / (key + ".o");
+    {
+      auto lock = std::lock_guard(mutex_);
+      pending_keys_[module] = key;
+    }
+    auto buffer = llvm::MemoryBuffer::getFile(path.string(), -1, false);
+    if (!buffer) { return nullptr; }
+    // nothing gets compiled for this module, there will be no notifyObjectCompiled().
+    {
+      auto lock = std::lock_guard(mutex_);
+      pending_keys_.erase(module);
+    }
+    return std::move(*buffer);
+  }
+
+  void notifyObjectCompiled(llvm::Module const* module, llvm::MemoryBufferRef object) override {
+    auto key = [&] {
+      auto lock = std::lock_guard(mutex_);
+      auto it = pending_keys_.find(module);
+      if (it == pending_keys_.end()) { return get_key(*module); }
+      auto key = std::move(it->second);
+      pending_keys_.erase(it);
+      return key;
+    }();
+
+    // write to a temporary file first, so that concurrent readers never observe a partially written object. the
+    // directory may be shared by several processes, the name of the temporary file has to be unique among all of them.
+    auto path = *directory_ / (key + ".o");
+    auto fd = 0;
+    auto tmp_path = llvm::SmallString<128>{};
+    if (llvm::sys::fs::createUniqueFile((*directory_ / (key + ".o.tmp%%%%%%%%")).string(), fd, tmp_path)) { return; }
+    {
+      auto os = llvm::raw_fd_ostream(fd, true);
+      os.write(object.getBufferStart(), object.getBufferSize());
+      os.close();
+      if (os.has_error()) {
+        os.clear_error();
+        llvm::sys::fs::remove(tmp_path);
+        return;
+      }
+    }
+    if (llvm::sys::fs::rename(tmp_path, path.string())) { llvm::sys::fs::remove(tmp_path); }
+  }
+
+private:
+  std::string get_key(llvm::Module const& module) const {
+    auto ir = std::string{};
+    auto os = llvm::raw_string_ostream(ir);
+    module.print(os, nullptr);
+    os.flush();
+
+    auto sha1 = llvm::SHA1{};
+    sha1.update(target_id_);
+    sha1.update(ir);
+    return llvm::toHex(sha1.final(), true);
+  }
+};
+
+} // namespace codegen
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "object_cache.hpp"
+#include "statistics.hpp"
+
+namespace codegen {
+
+enum class optimization_level {
+  O0,
+  O1,
+  O2,
+  O3,
+  Os,
+};
+
+namespace detail {
+
+// module flag used by module_builder to override the optimization level of its compiler_context.
+inline constexpr char const* optimization_level_flag = "codegen.optimization_level";
+
+// module flag that requests the fastest code generation, at the expense of the generated code. set on the baseline
+// tier of tiered modules, which is compiled only to be replaced.
+inline constexpr char const* fast_codegen_flag = "codegen.fast_codegen";
+
+inline optimization_level get_optimization_level(llvm::Module const& module, optimization_level fallback) {
+  auto flag = llvm::mdconst::extract_or_null<llvm::ConstantInt>(module.getModuleFlag(optimization_level_flag));
+  if (!flag) { return fallback; }
+  return static_cast<optimization_level>(flag->getZExtValue());
+}
+
+inline bool wants_fast_codegen(llvm::Module const& module) {
+  auto flag = llvm::mdconst::extract_or_null<llvm::ConstantInt>(module.getModuleFlag(fast_codegen_flag));
+  return flag && !flag->isZero();
+}
+
+// O0 only skips the IR pipeline, the backend stays at the default level of the JIT.
+inline llvm::CodeGenOpt::Level get_codegen_level(optimization_level level) {
+  switch (level) {
+  case optimization_level::O0: return llvm::CodeGenOpt::Default;
+  case optimization_level::O1: return llvm::CodeGenOpt::Less;
+  case optimization_level::O2: [[fallthrough]];
+  case optimization_level::Os: return llvm::CodeGenOpt::Default;
+  case optimization_level::O3: return llvm::CodeGenOpt::Aggressive;
+  }
+  llvm_unreachable("unknown optimization level");
+}
+
+inline llvm::PassBuilder::OptimizationLevel get_pass_builder_level(optimization_level level) {
+  switch (level) {
+  case optimization_level::O0: return llvm::PassBuilder::OptimizationLevel::O0;
+  case optimization_level::O1: return llvm::PassBuilder::OptimizationLevel::O1;
+  case optimization_level::O2: return llvm::PassBuilder::OptimizationLevel::O2;
+  case optimization_level::O3: return llvm::PassBuilder::OptimizationLevel::O3;
+  case optimization_level::Os: return llvm::PassBuilder::OptimizationLevel::Os;
+  }
+  llvm_unreachable("unknown optimization level");
+}
+
+// runs the default new pass manager pipeline for the given level. O0 leaves the module untouched.
+inline void optimize_module(llvm::Module& module, optimization_level level, llvm::TargetMachine& tm) {
+  if (level == optimization_level::O0) { return; }
+
+  if (module.getTargetTriple().empty()) { module.setTargetTriple(tm.getTargetTriple().str()); }
+
+  auto lam = llvm::LoopAnalysisManager{};
+  auto fam = llvm::FunctionAnalysisManager{};
+  auto cgam = llvm::CGSCCAnalysisManager{};
+  auto mam = llvm::ModuleAnalysisManager{};
+
+  auto pb = llvm::PassBuilder(false, &tm);
+  fam.registerPass([&] { return pb.buildDefaultAAPipeline(); });
+  pb.registerModuleAnalyses(mam);
+  pb.registerCGSCCAnalyses(cgam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+  auto mpm = pb.buildPerModuleDefaultPipeline(get_pass_builder_level(level));
+  mpm.run(module, mam);
+}
+
+// target machine for the code generation of the module, at the level it requests.
+inline llvm::Expected<std::unique_ptr<llvm::TargetMachine>>
+create_target_machine(llvm::orc::JITTargetMachineBuilder tmb, llvm::Module const& module,
+                      optimization_level default_level) {
+  auto fast = wants_fast_codegen(module);
+  tmb.setCodeGenOptLevel(fast ? llvm::CodeGenOpt::None
+                              : get_codegen_level(get_optimization_level(module, default_level)));
+  auto tm = tmb.createTargetMachine();
+  if (tm && fast) { (*tm)->setO0WantsFastISel(true); }
+  return tm;
+}
+
+// compiles each module with the codegen optimization level requested by that module, so that modules built at
+// different levels can share a single JIT. objects are looked up in and stored to the cache, if it is enabled.
+// the time spent is recorded as the code generation phase of the module, which then moves on to linking.
+class module_compiler : public llvm::orc::IRCompileLayer::IRCompiler {
+  llvm::orc::JITTargetMachineBuilder tmb_;
+  optimization_level default_level_;
+  object_cache* cache_;
+  pending_phases* phases_;
+
+public:
+  module_compiler(llvm::orc::JITTargetMachineBuilder tmb, optimization_level default_level, object_cache* cache,
+                  pending_phases* phases)
+      : IRCompiler(llvm::orc::irManglingOptionsFromTargetOptions(tmb.getOptions())), tmb_(std::move(tmb)),
+        default_level_(default_level), cache_(cache), phases_(phases) {}
+
+  // the module is only keyed while it is being compiled, the phase started by the IR transform always ends here.
+  llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> operator()(llvm::Module& module) override {
+    auto object = compile(module);
+    auto statistics = phases_->finish(&module, compile_phase::code_generation);
+    if (!object || !statistics) { return object; }
+    statistics->add_object((*object)->getBufferSize());
+    auto pending = std::make_unique<pending_object>(std::move(*object), *phases_);
+    phases_->start(pending.get(), std::move(statistics));
+    return std::move(pending);
+  }
+
+private:
+  llvm::Expected<std::unique_ptr<llvm::MemoryBuffer>> compile(llvm::Module& module) {
+    auto tm = create_target_machine(tmb_, module, default_level_);
+    if (!tm) { return tm.takeError(); }
+    return llvm::orc::SimpleCompiler(**tm, cache_->enabled() ? cache_ : nullptr)(module);
+  }
+};
+
+} // namespace detail
+
+} // namespace codegen
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include <unistd.h>
+
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/Object/SymbolSize.h>
+
+#include <fmt/format.h>
+
+namespace codegen::detail {
+
+// writes the address, size and name of every compiled function to /tmp/perf-<pid>.map, where perf report looks up
+// symbols of jitted code. the file belongs to the whole process, so there is a single listener shared by all contexts.
+class perf_map_listener : public llvm::JITEventListener {
+  std::mutex mutex_;
+  std::ofstream map_;
+
+  perf_map_listener() : map_(fmt::format("/tmp/perf-{}.map", getpid()), std::ios::trunc) {}
+
+public:
+  static perf_map_listener& get() {
+    static auto listener = perf_map_listener();
+    return listener;
+  }
+
+  void notifyObjectLoaded(ObjectKey, llvm::object::ObjectFile const& object,
+                          llvm::RuntimeDyld::LoadedObjectInfo const& info) override {
+    // the debug object has its sections relocated to the addresses the code was loaded at.
+    auto debug_object = info.getObjectForDebug(object);
+    auto& loaded = debug_object.getBinary() ? *debug_object.getBinary() : object;
+
+    auto lock = std::lock_guard(mutex_);
+    for (auto& [symbol, size] : llvm::object::computeSymbolSizes(loaded)) {
+      auto type = symbol.getType();
+      if (!type || *type != llvm::object::SymbolRef::ST_Function) {
+        if (!type) { llvm::consumeError(type.takeError()); }
+        continue;
+      }
+      auto name = symbol.getName();
+      if (!name) {
+        llvm::consumeError(name.takeError());
+        continue;
+      }
+      auto address = symbol.getAddress();
+      if (!address) {
+        llvm::consumeError(address.takeError());
+        continue;
+      }
+      map_ << fmt::format("{:x} {:x} {}\n", *address, size, name->str());
+    }
+    map_.flush();
+  }
+};
+
+} // namespace codegen::detail
@@ -23,6 +23,7 @@
 #pragma once
 
 #include "codegen/module_builder.hpp"
+#include "types.hpp"
 
 namespace codegen {
 
@@ -41,11 +42,12 @@ template<relational_operation_type Op, typename LHS, typename RHS> class relatio
   LHS lhs_;
   RHS rhs_;
 
-  using operand_type = typename LHS::value_type;
+  using operand_type = element_type_t<typename LHS::value_type>;
   static_assert(std::is_same_v<typename LHS::value_type, typename RHS::value_type>);
 
 public:
-  using value_type = bool;
+  // vectors are compared lane-wise, the result is a vector of bools.
+  using value_type = mask_type_t<typename LHS::value_type>;
 
   relational_operation(LHS lhs, RHS rhs) : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {}
 
@@ -117,42 +119,42 @@ public:
 } // namespace detail
 
 template<typename LHS, typename RHS,
-         typename = std::enable_if_t<std::is_arithmetic_v<typename RHS::value_type> &&
+         typename = std::enable_if_t<std::is_arithmetic_v<detail::element_type_t<typename RHS::value_type>> &&
                                      std::is_same_v<typename RHS::value_type, typename LHS::value_type>>>
 auto operator==(LHS lhs, RHS rhs) {
   return detail::relational_operation<detail::relational_operation_type::eq, LHS, RHS>(std::move(lhs), std::move(rhs));
 }
 
 template<typename LHS, typename RHS,
-         typename = std::enable_if_t<std::is_arithmetic_v<typename RHS::value_type> &&
+         typename = std::enable_if_t<std::is_arithmetic_v<detail::element_type_t<typename RHS::value_type>> &&
                                      std::is_same_v<typename RHS::value_type, typename LHS::value_type>>>
 auto operator!=(LHS lhs, RHS rhs) {
   return detail::relational_operation<detail::relational_operation_type::ne, LHS, RHS>(std::move(lhs), std::move(rhs));
 }
 
 template<typename LHS, typename RHS,
-         typename = std::enable_if_t<std::is_arithmetic_v<typename RHS::value_type> &&
+         typename = std::enable_if_t<std::is_arithmetic_v<detail::element_type_t<typename RHS::value_type>> &&
                                      std::is_same_v<typename RHS::value_type, typename LHS::value_type>>>
 auto operator>=(LHS lhs, RHS rhs) {
   return detail::relational_operation<detail::relational_operation_type::ge, LHS, RHS>(std::move(lhs), std::move(rhs));
 }
 
 template<typename LHS, typename RHS,
-         typename = std::enable_if_t<std::is_arithmetic_v<typename RHS::value_type> &&
+         typename = std::enable_if_t<std::is_arithmetic_v<detail::element_type_t<typename RHS::value_type>> &&
                                      std::is_same_v<typename RHS::value_type, typename LHS::value_type>>>
 auto operator>(LHS lhs, RHS rhs) {
   return detail::relational_operation<detail::relational_operation_type::gt, LHS, RHS>(std::move(lhs), std::move(rhs));
 }
 
 template<typename LHS, typename RHS,
-         typename = std::enable_if_t<std::is_arithmetic_v<typename RHS::value_type> &&
+         typename = std::enable_if_t<std::is_arithmetic_v<detail::element_type_t<typename RHS::value_type>> &&
                                      std::is_same_v<typename RHS::value_type, typename LHS::value_type>>>
 auto operator<=(LHS lhs, RHS rhs) {
   return detail::relational_operation<detail::relational_operation_type::le, LHS, RHS>(std::move(lhs), std::move(rhs));
 }
 
 template<typename LHS, typename RHS,
-         typename = std::enable_if_t<std::is_arithmetic_v<typename RHS::value_type> &&
+         typename = std::enable_if_t<std::is_arithmetic_v<detail::element_type_t<typename RHS::value_type>> &&
                                      std::is_same_v<typename RHS::value_type, typename LHS::value_type>>>
 auto operator<(LHS lhs, RHS rhs) {
   return detail::relational_operation<detail::relational_operation_type::lt, LHS, RHS>(std::move(lhs), std::move(rhs));
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Transforms/IPO/Internalize.h>
+
+#include "utils.hpp"
+
+namespace codegen::detail {
+
+// bitcode of helper functions that is linked into every module before it is optimized, so that calls to them can be
+// inlined into the generated code. only the functions a module refers to are copied, with internal linkage, and
+// dropped again once they are inlined. global variables are copied into every module as well, helpers that need
+// state shared with the host should keep it in memory passed to them.
+class runtime_library {
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> buffers_;
+
+public:
+  void add(std::filesystem::path const& path) {
+    auto buffer = llvm::MemoryBuffer::getFile(path.string());
+    if (!buffer) { throw llvm_error(llvm::errorCodeToError(buffer.getError())); }
+    add(std::move(*buffer));
+  }
+
+  void add(llvm::MemoryBufferRef bitcode) {
+    add(llvm::MemoryBuffer::getMemBufferCopy(bitcode.getBuffer(), bitcode.getBufferIdentifier()));
+  }
+
+  bool empty() const {
+    auto lock = std::lock_guard(mutex_);
+    return buffers_.empty();
+  }
+
+  // links the runtime functions the module calls into it. their target attributes are replaced with those of the
+  // generated code, functions with different targets are never inlined into each other.
+  void link_into(llvm::Module& module, std::string const& cpu, std::string const& features) const {
+    auto lock = std::lock_guard(mutex_);
+    if (buffers_.empty()) { return; }
+
+    auto linker = llvm::Linker(module);
+    for (auto& buffer : buffers_) {
+      auto runtime = llvm::getLazyBitcodeModule(buffer->getMemBufferRef(), module.getContext());
+      if (!runtime) { throw llvm_error(runtime.takeError()); }
+      (*runtime)->setTargetTriple(module.getTargetTriple());
+      (*runtime)->setDataLayout(module.getDataLayout());
+      auto failed = linker.linkInModule(
+          std::move(*runtime), llvm::Linker::LinkOnlyNeeded, [](llvm::Module& m, llvm::StringSet<> const& linked) {
+            llvm::internalizeModule(m, [&](llvm::GlobalValue const& gv) { return !linked.count(gv.getName()); });
+          });
+      if (failed) {
+        throw llvm_error(llvm::createStringError(llvm::inconvertibleErrorCode(), "failed to link runtime %s",
+                                                 buffer->getBufferIdentifier().str().c_str()));
+      }
+    }
+
+    for (auto& fn : module) {
+      if (fn.isDeclaration()) { continue; }
+      fn.addFnAttr("target-cpu", cpu);
+      if (features.empty()) {
+        fn.removeFnAttr("target-features");
+      } else {
+        fn.addFnAttr("target-features", features);
+      }
+    }
+  }
+
+private:
+  // the bitcode is parsed once here, so that a broken file is reported when it is added rather than by every build.
+  void add(std::unique_ptr<llvm::MemoryBuffer> buffer) {
+    auto context = llvm::LLVMContext{};
+    if (auto parsed = llvm::parseBitcodeFile(buffer->getMemBufferRef(), context); !parsed) {
+      throw llvm_error(parsed.takeError());
+    }
+    auto lock = std::lock_guard(mutex_);
+    buffers_.emplace_back(std::move(buffer));
+  }
+};
+
+} // namespace codegen::detail
@@ -0,0 +1,485 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ExecutionEngine/JITSymbol.h>
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <llvm/ExecutionEngine/RuntimeDyld.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/Memory.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "memory_manager.hpp"
+#include "optimizer.hpp"
+#include "utils.hpp"
+
+namespace codegen {
+
+namespace detail {
+
+struct shared_symbol {
+  std::string name;
+  uint64_t address;
+};
+
+inline constexpr char shared_cache_magic[8] = {'c', 'g', 's', 'h', 'a', 'r', 'e', 'd'};
+inline constexpr uint32_t shared_cache_version = 1;
+inline constexpr size_t shared_cache_max_entries = 4096;
+
+struct shared_cache_header {
+  char magic[8];
+  uint32_t version;
+  // entries are published by incrementing this, after everything they refer to has been written.
+  std::atomic<uint32_t> entries;
+  // the file is mapped at this address in every process, the code in it is relocated for it.
+  uint64_t base_address;
+  uint64_t capacity;
+  uint64_t used;
+  // offsets of the entries from the beginning of the file.
+  uint64_t offsets[shared_cache_max_entries];
+};
+
+// followed by the symbols of the module and the external symbols it has been linked against, each as a uint64_t
+// address, a uint32_t name length and the name, padded to 8 bytes. addresses of the symbols of the module are offsets
+// from the base address.
+struct shared_cache_entry {
+  char key[40];
+  uint32_t symbols;
+  uint32_t externals;
+  uint64_t image_offset;
+  uint64_t image_size;
+};
+
+inline size_t shared_symbols_size(std::vector<shared_symbol> const& symbols) {
+  auto size = size_t{0};
+  for (auto& s : symbols) { size += sizeof(uint64_t) + align_up(sizeof(uint32_t) + s.name.size(), 8); }
+  return size;
+}
+
+inline std::byte* write_shared_symbols(std::byte* out, std::vector<shared_symbol> const& symbols) {
+  for (auto& s : symbols) {
+    auto size = static_cast<uint32_t>(s.name.size());
+    std::memcpy(out, &s.address, sizeof(uint64_t));
+    std::memcpy(out + sizeof(uint64_t), &size, sizeof(uint32_t));
+    std::memcpy(out + sizeof(uint64_t) + sizeof(uint32_t), s.name.data(), size);
+    out += sizeof(uint64_t) + align_up(sizeof(uint32_t) + size, 8);
+  }
+  return out;
+}
+
+inline std::byte const* read_shared_symbols(std::byte const* in, uint32_t count, std::vector<shared_symbol>& symbols) {
+  for (auto i = 0u; i < count; i++) {
+    auto& s = symbols.emplace_back();
+    auto size = uint32_t{0};
+    std::memcpy(&s.address, in, sizeof(uint64_t));
+    std::memcpy(&size, in + sizeof(uint64_t), sizeof(uint32_t));
+    s.name.assign(reinterpret_cast<char const*>(in + sizeof(uint64_t) + sizeof(uint32_t)), size);
+    in += sizeof(uint64_t) + align_up(sizeof(uint32_t) + size, 8);
+  }
+  return in;
+}
+
+// code written into the cache must not depend on the process it was linked in. global variables other than constants
+// would be shared by all processes, and modules with them are compiled privately.
+inline bool is_shareable(llvm::Module const& module) {
+  return std::all_of(module.global_begin(), module.global_end(), [](llvm::GlobalVariable const& gv) {
+    return gv.isDeclaration() || (gv.isConstant() && !gv.isThreadLocal());
+  });
+}
+
+// places all sections of an object one after another in the cache file. the linker writes them through the writable
+// view, relocations are resolved against the executable view at the base address.
+class shared_image_memory_manager : public llvm::RTDyldMemoryManager {
+  struct section {
+    std::byte* address;
+    std::byte* exec_address;
+    size_t size;
+  };
+
+  std::byte* address_;
+  std::byte* exec_address_;
+  size_t available_;
+  size_t used_ = 0;
+  bool failed_ = false;
+
+  std::vector<section> sections_;
+  // sections of objects that do not fit or cannot be shared still need memory until the linker gives up on them.
+  std::vector<std::unique_ptr<std::byte[]>> discarded_;
+
+public:
+  shared_image_memory_manager(std::byte* address, std::byte* exec_address, size_t available)
+      : address_(address), exec_address_(exec_address), available_(available) {}
+
+  using llvm::RTDyldMemoryManager::notifyObjectLoaded;
+
+  uint8_t* allocateCodeSection(uintptr_t size, unsigned alignment, unsigned, llvm::StringRef) override {
+    return allocate(size, alignment);
+  }
+
+  uint8_t* allocateDataSection(uintptr_t size, unsigned alignment, unsigned, llvm::StringRef name,
+                               bool read_only) override {
+    // the global offset table does not change after relocation, any other writable data would.
+    if (!read_only && size && name != ".got") { failed_ = true; }
+    return allocate(size, alignment);
+  }
+
+  void notifyObjectLoaded(llvm::RuntimeDyld& dyld, llvm::object::ObjectFile const&) override {
+    for (auto& s : sections_) { dyld.mapSectionAddress(s.address, reinterpret_cast<uint64_t>(s.exec_address)); }
+  }
+
+  bool finalizeMemory(std::string*) override {
+    for (auto& s : sections_) { llvm::sys::Memory::InvalidateInstructionCache(s.exec_address, s.size); }
+    return false;
+  }
+
+  // unwind information is not registered, exceptions cannot propagate through shared code.
+  void registerEHFrames(uint8_t*, uint64_t, size_t) override {}
+  void deregisterEHFrames() override {}
+
+  bool failed() const { return failed_; }
+  size_t used() const { return used_; }
+
+private:
+  uint8_t* allocate(size_t size, unsigned alignment) {
+    alignment = std::max(alignment, 16u);
+    auto offset = align_up(used_, alignment);
+    if (failed_ || offset + size > available_) {
+      failed_ = true;
+      auto& memory = discarded_.emplace_back(std::make_unique<std::byte[]>(size + alignment));
+      return reinterpret_cast<uint8_t*>(align_up(reinterpret_cast<uintptr_t>(memory.get()), alignment));
+    }
+    used_ = offset + size;
+    sections_.push_back({address_ + offset, exec_address_ + offset, size});
+    return reinterpret_cast<uint8_t*>(address_ + offset);
+  }
+};
+
+class shared_symbol_resolver : public llvm::LegacyJITSymbolResolver {
+  std::function<uint64_t(std::string const&)> const* resolve_;
+  std::vector<shared_symbol>* resolved_;
+
+public:
+  shared_symbol_resolver(std::function<uint64_t(std::string const&)> const& resolve,
+                         std::vector<shared_symbol>& resolved)
+      : resolve_(&resolve), resolved_(&resolved) {}
+
+  llvm::JITSymbol findSymbolInLogicalDylib(std::string const&) override { return nullptr; }
+
+  llvm::JITSymbol findSymbol(std::string const& name) override {
+    auto address = (*resolve_)(name);
+    if (!address) { return nullptr; }
+    resolved_->push_back({name, address});
+    return llvm::JITSymbol(address, llvm::JITSymbolFlags::Exported);
+  }
+};
+
+// a cache file mapped into this process. all compiler contexts using the same file share a single mapping, the code
+// can be mapped only once at the base address.
+class shared_cache_file {
+  int fd_;
+  std::byte* address_;
+  std::byte* exec_address_;
+  size_t capacity_;
+
+public:
+  // serializes producers within this process, flock() does the same for other processes.
+  std::mutex mutex;
+
+  shared_cache_file(int fd, std::byte* address, std::byte* exec_address, size_t capacity)
+      : fd_(fd), address_(address), exec_address_(exec_address), capacity_(capacity) {}
+
+  ~shared_cache_file() {
+    munmap(address_, capacity_);
+    munmap(exec_address_, capacity_);
+    close(fd_);
+  }
+
+  shared_cache_file(shared_cache_file const&) = delete;
+  shared_cache_file& operator=(shared_cache_file const&) = delete;
+
+  int fd() const { return fd_; }
+  std::byte* address() const { return address_; }
+  std::byte* exec_address() const { return exec_address_; }
+  size_t capacity() const { return capacity_; }
+
+  shared_cache_header& header() const { return *reinterpret_cast<shared_cache_header*>(address_); }
+
+  // returns nullptr if the base address of the cache is not available in this process.
+  static std::shared_ptr<shared_cache_file> open(std::filesystem::path const& path, size_t capacity) {
+    static auto registry_mutex = std::mutex{};
+    static auto registry = std::map<std::pair<dev_t, ino_t>, std::weak_ptr<shared_cache_file>>{};
+
+    auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) { throw llvm_error(llvm::errorCodeToError(std::error_code(errno, std::generic_category()))); }
+    auto fail = [&] {
+      auto error = std::error_code(errno, std::generic_category());
+      close(fd);
+      throw llvm_error(llvm::errorCodeToError(error));
+    };
+
+    auto lock = std::lock_guard(registry_mutex);
+    if (flock(fd, LOCK_EX)) { fail(); }
+    struct stat st;
+    if (fstat(fd, &st)) { fail(); }
+    if (auto it = registry.find({st.st_dev, st.st_ino}); it != registry.end()) {
+      if (auto file = it->second.lock()) {
+        close(fd);
+        return file;
+      }
+    }
+
+    auto file = std::shared_ptr<shared_cache_file>{};
+    if (st.st_size == 0) {
+      capacity = align_up(std::max(capacity, sizeof(shared_cache_header) + page_size()), page_size());
+      if (ftruncate(fd, capacity)) { fail(); }
+      auto exec_address = mmap(nullptr, capacity, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+      if (exec_address == MAP_FAILED) { fail(); }
+      auto address = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (address == MAP_FAILED) {
+        munmap(exec_address, capacity);
+        fail();
+      }
+      file = std::make_shared<shared_cache_file>(fd, static_cast<std::byte*>(address),
+                                                 static_cast<std::byte*>(exec_address), capacity);
+      auto& header = file->header();
+      header.version = shared_cache_version;
+      header.base_address = reinterpret_cast<uint64_t>(exec_address);
+      header.capacity = capacity;
+      header.used = align_up(sizeof(shared_cache_header), page_size());
+      std::memcpy(header.magic, shared_cache_magic, sizeof(shared_cache_magic));
+    } else {
+      auto header = shared_cache_header{};
+      auto read = pread(fd, &header, offsetof(shared_cache_header, offsets), 0);
+      if (read < 0) { fail(); }
+      if (size_t(read) != offsetof(shared_cache_header, offsets) ||
+          std::memcmp(header.magic, shared_cache_magic, sizeof(shared_cache_magic)) ||
+          header.version != shared_cache_version) {
+        close(fd);
+        throw llvm_error(llvm::createStringError(llvm::inconvertibleErrorCode(), "%s is not a shared code cache",
+                                                 path.c_str()));
+      }
+      capacity = header.capacity;
+      auto base = reinterpret_cast<void*>(header.base_address);
+#ifdef MAP_FIXED_NOREPLACE
+      auto exec_address = mmap(base, capacity, PROT_READ | PROT_EXEC, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+#else
+      auto exec_address = mmap(base, capacity, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+#endif
+      if (exec_address != base) {
+        if (exec_address != MAP_FAILED) { munmap(exec_address, capacity); }
+        close(fd);
+        return nullptr;
+      }
+      auto address = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (address == MAP_FAILED) {
+        munmap(exec_address, capacity);
+        fail();
+      }
+      file = std::make_shared<shared_cache_file>(fd, static_cast<std::byte*>(address),
+                                                 static_cast<std::byte*>(exec_address), capacity);
+    }
+    if (flock(fd, LOCK_UN)) {
+      // the file owns the descriptor now.
+      auto error = std::error_code(errno, std::generic_category());
+      file.reset();
+      throw llvm_error(llvm::errorCodeToError(error));
+    }
+    registry[{st.st_dev, st.st_ino}] = file;
+    return file;
+  }
+};
+
+} // namespace detail
+
+// compiled modules shared by all processes that use the same cache file, e.g. a pool of workers running the same
+// queries. the code is linked once, directly into the file, for an address at which every process maps it read-only
+// and executable. entries are keyed by a hash of the IR together with the target and the optimization level. external
+// symbols are resolved when an entry is written, it is used by another process only if they resolve to the same
+// addresses there, as they do in processes forked from a common parent or started from the same binary without
+// address space randomization.
+class shared_code_cache {
+  std::string target_id_;
+  std::shared_ptr<detail::shared_cache_file> file_;
+
+  std::atomic<size_t> hits_{0};
+  std::atomic<size_t> misses_{0};
+  std::atomic<size_t> inserts_{0};
+  std::atomic<size_t> rejected_{0};
+
+public:
+  explicit shared_code_cache(std::string target_id) : target_id_(std::move(target_id)) {}
+
+  // the cache stays disabled if its base address is already taken in this process.
+  void open(std::filesystem::path const& path, size_t capacity) {
+    file_ = detail::shared_cache_file::open(path, capacity);
+  }
+
+  bool enabled() const { return file_ != nullptr; }
+
+  size_t hits() const { return hits_.load(); }
+  size_t misses() const { return misses_.load(); }
+  size_t inserts() const { return inserts_.load(); }
+  // entries that exist but were linked against external symbols at different addresses.
+  size_t rejected() const { return rejected_.load(); }
+
+  // bytes of the file in use, by all processes.
+  size_t used() const { return file_ ? header().used : 0; }
+
+  std::string get_key(llvm::Module const& module, optimization_level level) const {
+    auto ir = std::string{};
+    auto os = llvm::raw_string_ostream(ir);
+    module.print(os, nullptr);
+    os.flush();
+
+    auto sha1 = llvm::SHA1{};
+    sha1.update(target_id_);
+    sha1.update(std::to_string(static_cast<unsigned>(level)));
+    sha1.update(ir);
+    return llvm::toHex(sha1.final(), true);
+  }
+
+  // returns the addresses of the symbols of the module with the given key, if the cache has it and the external
+  // symbols it has been linked against resolve to the same addresses in this process.
+  std::optional<std::vector<detail::shared_symbol>>
+  find(std::string const& key, std::function<uint64_t(std::string const&)> const& resolve) {
+    auto rejected = false;
+    auto symbols = find_entry(key, resolve, rejected);
+    if (symbols) {
+      hits_++;
+    } else {
+      misses_++;
+      if (rejected) { rejected_++; }
+    }
+    return symbols;
+  }
+
+  // links the object into the cache and returns the addresses of the given symbols. returns nullopt if the cache is
+  // full, the object cannot be shared or the file cannot be locked.
+  std::optional<std::vector<detail::shared_symbol>>
+  insert(std::string const& key, llvm::MemoryBufferRef object, std::vector<std::string> const& names,
+         std::function<uint64_t(std::string const&)> const& resolve) {
+    auto lock = std::lock_guard(file_->mutex);
+    if (flock(file_->fd(), LOCK_EX)) { return std::nullopt; }
+    auto result = insert_locked(key, object, names, resolve);
+    // other processes would block on the file forever, stop writing to it.
+    if (flock(file_->fd(), LOCK_UN)) {
+      throw llvm_error(llvm::errorCodeToError(std::error_code(errno, std::generic_category())));
+    }
+    return result;
+  }
+
+private:
+  detail::shared_cache_header const& header() const { return file_->header(); }
+
+  // there may be several entries for the same key, linked against different external symbols.
+  std::optional<std::vector<detail::shared_symbol>>
+  find_entry(std::string const& key, std::function<uint64_t(std::string const&)> const& resolve, bool& rejected) {
+    auto& h = header();
+    auto base = reinterpret_cast<uint64_t>(file_->exec_address());
+    auto count = h.entries.load(std::memory_order_acquire);
+    for (auto i = 0u; i < count; i++) {
+      auto entry = reinterpret_cast<detail::shared_cache_entry const*>(file_->address() + h.offsets[i]);
+      if (key.compare(0, key.size(), entry->key, sizeof(entry->key))) { continue; }
+
+      auto symbols = std::vector<detail::shared_symbol>{};
+      auto externals = std::vector<detail::shared_symbol>{};
+      auto in = reinterpret_cast<std::byte const*>(entry + 1);
+      in = detail::read_shared_symbols(in, entry->symbols, symbols);
+      detail::read_shared_symbols(in, entry->externals, externals);
+      auto resolves = [&](detail::shared_symbol const& ext) { return resolve(ext.name) == ext.address; };
+      if (!std::all_of(externals.begin(), externals.end(), resolves)) {
+        rejected = true;
+        continue;
+      }
+      for (auto& s : symbols) { s.address += base; }
+      return symbols;
+    }
+    return std::nullopt;
+  }
+
+  std::optional<std::vector<detail::shared_symbol>>
+  insert_locked(std::string const& key, llvm::MemoryBufferRef object, std::vector<std::string> const& names,
+                std::function<uint64_t(std::string const&)> const& resolve) {
+    // another producer may have linked the same module in the meantime.
+    auto rejected = false;
+    if (auto symbols = find_entry(key, resolve, rejected)) { return symbols; }
+
+    auto& h = file_->header();
+    auto count = h.entries.load(std::memory_order_relaxed);
+    if (count == detail::shared_cache_max_entries) { return std::nullopt; }
+
+    auto image_offset = detail::align_up(h.used, detail::page_size());
+    if (image_offset >= file_->capacity()) { return std::nullopt; }
+    auto memory_manager = detail::shared_image_memory_manager(
+        file_->address() + image_offset, file_->exec_address() + image_offset, file_->capacity() - image_offset);
+    auto externals = std::vector<detail::shared_symbol>{};
+    auto resolver = detail::shared_symbol_resolver(resolve, externals);
+
+    auto obj = llvm::object::ObjectFile::createObjectFile(object);
+    if (!obj) {
+      llvm::consumeError(obj.takeError());
+      return std::nullopt;
+    }
+    auto dyld = llvm::RuntimeDyld(memory_manager, resolver);
+    dyld.loadObject(**obj);
+    if (!dyld.hasError()) { dyld.finalizeWithMemoryManagerLocking(); }
+    if (dyld.hasError() || memory_manager.failed()) { return std::nullopt; }
+
+    auto base = reinterpret_cast<uint64_t>(file_->exec_address());
+    auto symbols = std::vector<detail::shared_symbol>{};
+    for (auto& name : names) {
+      auto symbol = dyld.getSymbol(name);
+      if (!symbol) { return std::nullopt; }
+      symbols.push_back({name, symbol.getAddress() - base});
+    }
+
+    auto entry_offset = detail::align_up(image_offset + memory_manager.used(), 8);
+    auto end = entry_offset + sizeof(detail::shared_cache_entry) + detail::shared_symbols_size(symbols) +
+               detail::shared_symbols_size(externals);
+    if (end > file_->capacity()) { return std::nullopt; }
+
+    auto entry = reinterpret_cast<detail::shared_cache_entry*>(file_->address() + entry_offset);
+    std::memcpy(entry->key, key.data(), std::min(key.size(), sizeof(entry->key)));
+    entry->symbols = symbols.size();
+    entry->externals = externals.size();
+    entry->image_offset = image_offset;
+    entry->image_size = memory_manager.used();
+    auto out = detail::write_shared_symbols(reinterpret_cast<std::byte*>(entry + 1), symbols);
+    detail::write_shared_symbols(out, externals);
+
+    h.offsets[count] = entry_offset;
+    h.used = end;
+    h.entries.store(count + 1, std::memory_order_release);
+    inserts_++;
+
+    for (auto& s : symbols) { s.address += base; }
+    return symbols;
+  }
+};
+
+} // namespace codegen
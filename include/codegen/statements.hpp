@@ -22,25 +22,133 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Metadata.h>
+
 #include "module_builder.hpp"
 #include "types.hpp"
 #include "utils.hpp"
 
 namespace codegen {
 
+namespace detail {
+
+// the weights llvm.expect gives to the expected and the other successor of a branch.
+inline constexpr uint32_t likely_branch_weight = 2000;
+inline constexpr uint32_t unlikely_branch_weight = 1;
+
+template<typename Condition> class weighted_condition {
+  Condition condition_;
+  uint32_t true_weight_;
+  uint32_t false_weight_;
+
+public:
+  using value_type = bool;
+
+  weighted_condition(Condition cnd, uint32_t true_weight, uint32_t false_weight)
+      : condition_(std::move(cnd)), true_weight_(true_weight), false_weight_(false_weight) {}
+
+  llvm::Value* eval() const { return condition_.eval(); }
+
+  std::pair<uint32_t, uint32_t> weights() const { return {true_weight_, false_weight_}; }
+
+  friend std::ostream& operator<<(std::ostream& os, weighted_condition const& wc) {
+    if (wc.true_weight_ == likely_branch_weight && wc.false_weight_ == unlikely_branch_weight) {
+      return os << "likely(" << wc.condition_ << ")";
+    } else if (wc.true_weight_ == unlikely_branch_weight && wc.false_weight_ == likely_branch_weight) {
+      return os << "unlikely(" << wc.condition_ << ")";
+    }
+    return os << "weighted(" << wc.condition_ << ", " << wc.true_weight_ << ", " << wc.false_weight_ << ")";
+  }
+};
+
+template<typename Block> class cold_block {
+  Block body_;
+
+public:
+  explicit cold_block(Block body) : body_(std::move(body)) {}
+
+  void operator()() { body_(); }
+};
+
+template<typename T> struct is_weighted_condition : std::false_type {};
+template<typename Condition> struct is_weighted_condition<weighted_condition<Condition>> : std::true_type {};
+
+template<typename T> struct is_cold_block : std::false_type {};
+template<typename Block> struct is_cold_block<cold_block<Block>> : std::true_type {};
+
+// conditional branch with the weights of the condition, if it has any, or the ones implied by cold blocks.
+template<typename Condition>
+llvm::BranchInst* create_cond_br(Condition&& cnd, llvm::BasicBlock* true_block, llvm::BasicBlock* false_block,
+                                 std::optional<std::pair<uint32_t, uint32_t>> weights = std::nullopt) {
+  auto& mb = *module_builder::current_builder();
+  if constexpr (is_weighted_condition<std::decay_t<Condition>>::value) { weights = cnd.weights(); }
+  auto br = mb.ir_builder().CreateCondBr(cnd.eval(), true_block, false_block);
+  if (weights) {
+    br->setMetadata(llvm::LLVMContext::MD_prof,
+                    llvm::MDBuilder(mb.context()).createBranchWeights(weights->first, weights->second));
+  }
+  return br;
+}
+
+template<typename TrueBlock, typename FalseBlock>
+std::optional<std::pair<uint32_t, uint32_t>> get_cold_block_weights() {
+  constexpr auto cold_true = is_cold_block<std::decay_t<TrueBlock>>::value;
+  constexpr auto cold_false = is_cold_block<std::decay_t<FalseBlock>>::value;
+  if constexpr (cold_true && !cold_false) {
+    return std::pair{unlikely_branch_weight, likely_branch_weight};
+  } else if constexpr (cold_false && !cold_true) {
+    return std::pair{likely_branch_weight, unlikely_branch_weight};
+  } else {
+    return std::nullopt;
+  }
+}
+
+} // namespace detail
+
+// branch hints. the optimizer lays out the likely successor of a branch as the fall-through and moves the other one
+// out of the hot path, e.g. if_(unlikely_(ptr == null), [&] { ... }).
+template<ConditionType Condition> inline auto likely_(Condition cnd) {
+  return detail::weighted_condition<Condition>(std::move(cnd), detail::likely_branch_weight,
+                                               detail::unlikely_branch_weight);
+}
+
+template<ConditionType Condition> inline auto unlikely_(Condition cnd) {
+  return detail::weighted_condition<Condition>(std::move(cnd), detail::unlikely_branch_weight,
+                                               detail::likely_branch_weight);
+}
+
+// relative frequencies of the condition being true and false, e.g. taken from a profile.
+template<ConditionType Condition> inline auto weighted_(Condition cnd, uint32_t true_weight, uint32_t false_weight) {
+  return detail::weighted_condition<Condition>(std::move(cnd), true_weight, false_weight);
+}
+
+// marks a block of if_() as rarely executed, e.g. error handling. unless the condition has weights of its own, the
+// branch to it is weighted as unlikely and the block is placed after the hot code of the function.
+template<typename Block> inline auto cold_(Block body) {
+  return detail::cold_block<Block>(std::move(body));
+}
+
 template<ConditionType Condition, typename TrueBlock, typename FalseBlock,
          typename = std::enable_if_t<std::is_same_v<typename std::decay_t<Condition>::value_type, bool>>>
 inline void if_(Condition&& cnd, TrueBlock&& tb, FalseBlock&& fb) {
   auto& mb = *module_builder::current_builder();
 
-  auto line_no = mb.source_code_.add_line(fmt::format("if ({}) {{", cnd));
+  auto line_no = mb.source_code_.add_line([&] { return fmt::format("if ({}) {{", cnd); });
   mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
 
   auto true_block = llvm::BasicBlock::Create(mb.context(), "true_block", mb.current_function());
   auto false_block = llvm::BasicBlock::Create(mb.context(), "false_block");
   auto merge_block = llvm::BasicBlock::Create(mb.context(), "merge_block");
 
-  mb.ir_builder().CreateCondBr(cnd.eval(), true_block, false_block);
+  detail::create_cond_br(cnd, true_block, false_block, detail::get_cold_block_weights<TrueBlock, FalseBlock>());
 
   mb.ir_builder().SetInsertPoint(true_block);
   mb.source_code_.enter_scope();
@@ -81,13 +189,13 @@ template<typename Condition, typename TrueBlock,
 inline void if_(Condition&& cnd, TrueBlock&& tb) {
   auto& mb = *module_builder::current_builder();
 
-  auto line_no = mb.source_code_.add_line(fmt::format("if ({}) {{", cnd));
+  auto line_no = mb.source_code_.add_line([&] { return fmt::format("if ({}) {{", cnd); });
   mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
 
   auto true_block = llvm::BasicBlock::Create(mb.context(), "true_block", mb.current_function());
   auto merge_block = llvm::BasicBlock::Create(mb.context(), "merge_block");
 
-  mb.ir_builder().CreateCondBr(cnd.eval(), true_block, merge_block);
+  detail::create_cond_br(cnd, true_block, merge_block, detail::get_cold_block_weights<TrueBlock, void>());
 
   mb.ir_builder().SetInsertPoint(true_block);
 
@@ -115,11 +223,13 @@ inline value<ReturnType> call(function_ref<ReturnType, Arguments...> const& fn,
   auto& mb = *module_builder::current_builder();
 
   {
-    auto str = std::stringstream{};
-    str << fn.name() << "_ret = " << fn.name() << "(";
-    (void)(str << ... << fmt::format("{}, ", args));
-    str << ");";
-    auto line_no = mb.source_code_.add_line(str.str());
+    auto line_no = mb.source_code_.add_line([&] {
+      auto str = std::stringstream{};
+      str << fn.name() << "_ret = " << fn.name() << "(";
+      (void)(str << ... << fmt::format("{}, ", args));
+      str << ");";
+      return str.str();
+    });
     mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
   }
 
@@ -137,14 +247,16 @@ inline auto load(Pointer ptr) {
 
   auto id = fmt::format("val{}", detail::id_counter++);
 
-  auto line_no = mb.source_code_.add_line(fmt::format("{} = *{}", id, ptr));
+  auto line_no = mb.source_code_.add_line([&] { return fmt::format("{} = *{}", id, ptr); });
   mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
   auto v = mb.ir_builder().CreateAlignedLoad(ptr.eval(), llvm::MaybeAlign(detail::type<value_type>::alignment));
 
-  auto dbg_value = mb.debug_builder().createAutoVariable(
-      mb.source_code_.debug_scope(), id, mb.source_code_.debug_file(), line_no, detail::type<value_type>::dbg());
-  mb.debug_builder().insertDbgValueIntrinsic(v, dbg_value, mb.debug_builder().createExpression(),
-                                             mb.get_debug_location(line_no), mb.ir_builder().GetInsertBlock());
+  if (mb.debug_info_enabled()) {
+    auto dbg_value = mb.debug_builder().createAutoVariable(
+        mb.source_code_.debug_scope(), id, mb.source_code_.debug_file(), line_no, detail::type<value_type>::dbg());
+    mb.debug_builder().insertDbgValueIntrinsic(v, dbg_value, mb.debug_builder().createExpression(),
+                                               mb.get_debug_location(line_no), mb.ir_builder().GetInsertBlock());
+  }
 
   return value<value_type>{v, id};
 }
@@ -159,7 +271,7 @@ inline void store(Value v, Pointer ptr) {
   using value_type = std::remove_pointer_t<typename std::decay_t<Pointer>::value_type>;
   auto& mb = *module_builder::current_builder();
 
-  auto line_no = mb.source_code_.add_line(fmt::format("*{} = {}", ptr, v));
+  auto line_no = mb.source_code_.add_line([&] { return fmt::format("*{} = {}", ptr, v); });
   mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
   mb.ir_builder().CreateAlignedStore(v.eval(), ptr.eval(), llvm::MaybeAlign(detail::type<value_type>::alignment));
 }
@@ -172,7 +284,7 @@ inline void while_(ConditionFn cnd_fn, Body bdy) {
   auto line_no = mb.source_code_.current_line() + 1;
   mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
   auto cnd = cnd_fn();
-  mb.source_code_.add_line(fmt::format("while ({}) {{", cnd));
+  mb.source_code_.add_line([&] { return fmt::format("while ({}) {{", cnd); });
 
   auto while_continue = llvm::BasicBlock::Create(mb.context(), "while_continue", mb.current_function());
   auto while_iteration = llvm::BasicBlock::Create(mb.context(), "while_iteration");
@@ -183,7 +295,7 @@ inline void while_(ConditionFn cnd_fn, Body bdy) {
   mb.ir_builder().CreateBr(while_continue);
   mb.ir_builder().SetInsertPoint(while_continue);
 
-  mb.ir_builder().CreateCondBr(cnd_fn().eval(), while_iteration, while_break);
+  detail::create_cond_br(cnd_fn(), while_iteration, while_break);
 
   mb.source_code_.enter_scope();
 
@@ -209,6 +321,261 @@ inline void while_(ConditionFn cnd_fn, Body bdy) {
   mb.current_loop_ = parent_loop;
 }
 
+namespace detail {
+
+template<typename T, typename Body> struct switch_case {
+  T value;
+  Body body;
+  std::optional<uint32_t> weight;
+};
+
+template<typename Body> struct switch_default {
+  Body body;
+  std::optional<uint32_t> weight;
+};
+
+template<typename T> struct is_switch_default : std::false_type {};
+template<typename Body> struct is_switch_default<switch_default<Body>> : std::true_type {};
+
+// whether a case value is representable in the type of the switch. std::in_range() does not accept character types.
+template<typename To, typename From> constexpr bool is_case_in_range(From value) {
+  using from_type = std::conditional_t<std::is_signed_v<From>, intmax_t, uintmax_t>;
+  using to_type = std::conditional_t<std::is_signed_v<To>, intmax_t, uintmax_t>;
+  return std::cmp_greater_equal(from_type(value), to_type(std::numeric_limits<To>::min())) &&
+         std::cmp_less_equal(from_type(value), to_type(std::numeric_limits<To>::max()));
+}
+
+} // namespace detail
+
+// a case of switch_(), its weight is the relative frequency with which it is taken.
+template<std::integral T, typename Body> inline auto case_(T value, Body body) {
+  return detail::switch_case<T, Body>{value, std::move(body), std::nullopt};
+}
+
+template<std::integral T, typename Body> inline auto case_(T value, Body body, uint32_t weight) {
+  return detail::switch_case<T, Body>{value, std::move(body), weight};
+}
+
+template<typename Body> inline auto default_(Body body) {
+  return detail::switch_default<Body>{std::move(body), std::nullopt};
+}
+
+template<typename Body> inline auto default_(Body body, uint32_t weight) {
+  return detail::switch_default<Body>{std::move(body), weight};
+}
+
+// multi-way branch on an integer, e.g. switch_(v, case_(1, [&] { ... }), case_(2, [&] { ... }), default_([&] { ... })).
+// it is emitted as a single switch instruction, which the backend lowers to a jump table if the cases are dense
+// enough. cases do not fall through and break_() and continue_() refer to the enclosing loop, as in the other
+// statements. if any case has a weight, those without one are given a weight of 1. throws if a case value is repeated
+// or does not fit the type of v.
+template<typename Value, typename... Cases>
+requires LLVMTypeWrapper<Value> && LLVMIntegralType<typename Value::value_type> &&
+    (!LLVMBoolType<typename Value::value_type>)
+inline void switch_(Value v, Cases... cases) {
+  using value_type = typename Value::value_type;
+  static_assert((detail::is_switch_default<Cases>::value + ... + 0) <= 1, "switch_ can have only one default_");
+  auto& mb = *module_builder::current_builder();
+
+  // checked before anything is emitted, llvm would only reject the switch when verifying the whole module.
+  auto case_values = std::vector<value_type>{};
+  auto check_case = [&](auto const& c) {
+    if constexpr (!detail::is_switch_default<std::decay_t<decltype(c)>>::value) {
+      if (!detail::is_case_in_range<value_type>(c.value)) {
+        auto message = fmt::format("case_ value {} out of range of the switch_ type", +c.value);
+        throw llvm_error(llvm::createStringError(llvm::inconvertibleErrorCode(), message.c_str()));
+      }
+      auto value = static_cast<value_type>(c.value);
+      if (std::find(case_values.begin(), case_values.end(), value) != case_values.end()) {
+        auto message = fmt::format("duplicate case_ value {}", +c.value);
+        throw llvm_error(llvm::createStringError(llvm::inconvertibleErrorCode(), message.c_str()));
+      }
+      case_values.push_back(value);
+    }
+  };
+  (check_case(cases), ...);
+
+  auto line_no = mb.source_code_.add_line([&] { return fmt::format("switch ({}) {{", v); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+
+  constexpr auto has_default = (detail::is_switch_default<Cases>::value || ...);
+  auto merge_block = llvm::BasicBlock::Create(mb.context(), "switch_merge");
+  auto default_block = has_default ? llvm::BasicBlock::Create(mb.context(), "switch_default") : merge_block;
+
+  constexpr auto case_count = sizeof...(Cases) - (has_default ? 1 : 0);
+  auto sw = mb.ir_builder().CreateSwitch(v.eval(), default_block, case_count);
+
+  // the first weight is the one of the default destination.
+  auto weights = std::vector<uint32_t>{1};
+  auto has_weights = false;
+
+  auto emit_block = [&](llvm::BasicBlock* block, std::string const& label, auto& body) {
+    mb.current_function()->getBasicBlockList().push_back(block);
+    mb.ir_builder().SetInsertPoint(block);
+
+    auto case_line_no = mb.source_code_.add_line(label);
+    mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(case_line_no));
+    mb.source_code_.enter_scope();
+    assert(!mb.exited_block_);
+    body();
+    mb.source_code_.leave_scope();
+
+    case_line_no = mb.source_code_.add_line("}");
+    if (!mb.exited_block_) {
+      mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(case_line_no));
+      mb.ir_builder().CreateBr(merge_block);
+    }
+    mb.exited_block_ = false;
+  };
+
+  mb.source_code_.enter_scope();
+  auto emit_case = [&](auto& c) {
+    has_weights = has_weights || c.weight.has_value();
+    if constexpr (detail::is_switch_default<std::decay_t<decltype(c)>>::value) {
+      weights[0] = c.weight.value_or(1);
+      emit_block(default_block, "default: {", c.body);
+    } else {
+      auto case_value = llvm::ConstantInt::get(mb.context(), llvm::APInt(sizeof(value_type) * 8, c.value,
+                                                                         std::is_signed_v<value_type>));
+      auto block = llvm::BasicBlock::Create(mb.context(), "switch_case");
+      sw->addCase(case_value, block);
+      weights.emplace_back(c.weight.value_or(1));
+      emit_block(block, fmt::format("case {}: {{", c.value), c.body);
+    }
+  };
+  (emit_case(cases), ...);
+  mb.source_code_.leave_scope();
+
+  if (has_weights) {
+    sw->setMetadata(llvm::LLVMContext::MD_prof, llvm::MDBuilder(mb.context()).createBranchWeights(weights));
+  }
+
+  line_no = mb.source_code_.add_line("}");
+  mb.current_function()->getBasicBlockList().push_back(merge_block);
+  mb.ir_builder().SetInsertPoint(merge_block);
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+}
+
+// hints for the loop optimizations of llvm, attached to a loop as llvm.loop metadata. unset hints are left to the
+// heuristics of the optimizer.
+struct loop_hints {
+  std::optional<bool> vectorize;
+  std::optional<unsigned> vectorize_width;
+  std::optional<unsigned> interleave_count;
+  std::optional<unsigned> unroll_count;
+  bool unroll_full = false;
+  std::optional<bool> distribute;
+};
+
+namespace detail {
+
+inline llvm::MDNode* get_loop_metadata(llvm::LLVMContext& context, loop_hints const& hints) {
+  auto operands = std::vector<llvm::Metadata*>{nullptr};
+  auto add = [&](char const* name, llvm::Constant* value) {
+    auto node = std::vector<llvm::Metadata*>{llvm::MDString::get(context, name)};
+    if (value) { node.emplace_back(llvm::ConstantAsMetadata::get(value)); }
+    operands.emplace_back(llvm::MDNode::get(context, node));
+  };
+  auto i1 = [&](bool v) { return llvm::ConstantInt::get(llvm::Type::getInt1Ty(context), v); };
+  auto i32 = [&](unsigned v) { return llvm::ConstantInt::get(llvm::Type::getInt32Ty(context), v); };
+
+  if (hints.vectorize) { add("llvm.loop.vectorize.enable", i1(*hints.vectorize)); }
+  if (hints.vectorize_width) { add("llvm.loop.vectorize.width", i32(*hints.vectorize_width)); }
+  if (hints.interleave_count) { add("llvm.loop.interleave.count", i32(*hints.interleave_count)); }
+  if (hints.unroll_count) { add("llvm.loop.unroll.count", i32(*hints.unroll_count)); }
+  if (hints.unroll_full) { add("llvm.loop.unroll.full", nullptr); }
+  if (hints.distribute) { add("llvm.loop.distribute.enable", i1(*hints.distribute)); }
+  if (operands.size() == 1) { return nullptr; }
+
+  // the first operand of a loop id refers to the node itself, that keeps the ids of distinct loops distinct.
+  auto loop_id = llvm::MDNode::getDistinct(context, operands);
+  loop_id->replaceOperandWith(0, loop_id);
+  return loop_id;
+}
+
+} // namespace detail
+
+// counted loop over [begin, end) with a positive step. the induction variable is passed to the body, unlike the
+// condition of while_() it is a canonical induction variable the loop optimizations recognize. end and step are
+// evaluated once, before the loop.
+template<typename Begin, typename End, typename Step, typename Body>
+requires LLVMTypeWrapper<Begin> && LLVMIntegralType<typename Begin::value_type> &&
+    std::same_as<typename Begin::value_type, typename End::value_type> &&
+    std::same_as<typename Begin::value_type, typename Step::value_type>
+inline void for_(Begin begin, End end, Step step, Body bdy, loop_hints const& hints = {}) {
+  using value_type = typename Begin::value_type;
+  auto& mb = *module_builder::current_builder();
+
+  auto id = fmt::format("idx{}", detail::id_counter++);
+  auto line_no = mb.source_code_.add_line(
+      [&] { return fmt::format("for ({0} = {1}; {0} < {2}; {0} += {3}) {{", id, begin, end, step); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+
+  auto begin_value = begin.eval();
+  auto end_value = end.eval();
+  auto step_value = step.eval();
+  auto preheader = mb.ir_builder().GetInsertBlock();
+
+  auto for_header = llvm::BasicBlock::Create(mb.context(), "for_header", mb.current_function());
+  auto for_iteration = llvm::BasicBlock::Create(mb.context(), "for_iteration");
+  auto for_continue = llvm::BasicBlock::Create(mb.context(), "for_continue");
+  auto for_break = llvm::BasicBlock::Create(mb.context(), "for_break");
+
+  auto parent_loop = std::exchange(mb.current_loop_, module_builder::loop{for_continue, for_break});
+
+  mb.ir_builder().CreateBr(for_header);
+  mb.ir_builder().SetInsertPoint(for_header);
+  auto induction = mb.ir_builder().CreatePHI(detail::type<value_type>::llvm(), 2, id);
+  induction->addIncoming(begin_value, preheader);
+  if constexpr (std::is_signed_v<value_type>) {
+    mb.ir_builder().CreateCondBr(mb.ir_builder().CreateICmpSLT(induction, end_value), for_iteration, for_break);
+  } else {
+    mb.ir_builder().CreateCondBr(mb.ir_builder().CreateICmpULT(induction, end_value), for_iteration, for_break);
+  }
+
+  mb.source_code_.enter_scope();
+
+  mb.current_function()->getBasicBlockList().push_back(for_iteration);
+  mb.ir_builder().SetInsertPoint(for_iteration);
+
+  if (mb.debug_info_enabled()) {
+    auto dbg_value = mb.debug_builder().createAutoVariable(
+        mb.source_code_.debug_scope(), id, mb.source_code_.debug_file(), line_no, detail::type<value_type>::dbg());
+    mb.debug_builder().insertDbgValueIntrinsic(induction, dbg_value, mb.debug_builder().createExpression(),
+                                               mb.get_debug_location(line_no), for_iteration);
+  }
+
+  assert(!mb.exited_block_);
+  bdy(value<value_type>{induction, id});
+
+  mb.source_code_.leave_scope();
+
+  line_no = mb.source_code_.add_line("}");
+
+  if (!mb.exited_block_) {
+    mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+    mb.ir_builder().CreateBr(for_continue);
+  }
+  mb.exited_block_ = false;
+
+  mb.current_function()->getBasicBlockList().push_back(for_continue);
+  mb.ir_builder().SetInsertPoint(for_continue);
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+  // as in c, signed induction variables are assumed not to overflow.
+  auto next = std::is_signed_v<value_type> ? mb.ir_builder().CreateNSWAdd(induction, step_value)
+                                           : mb.ir_builder().CreateAdd(induction, step_value);
+  induction->addIncoming(next, for_continue);
+  auto latch = mb.ir_builder().CreateBr(for_header);
+  if (auto loop_id = detail::get_loop_metadata(mb.context(), hints)) {
+    latch->setMetadata(llvm::LLVMContext::MD_loop, loop_id);
+  }
+
+  mb.current_function()->getBasicBlockList().push_back(for_break);
+  mb.ir_builder().SetInsertPoint(for_break);
+
+  mb.current_loop_ = parent_loop;
+}
+
 inline void break_() {
   auto& mb = *module_builder::current_builder();
   assert(mb.current_loop_.break_block_);
@@ -241,6 +608,48 @@ inline value<bool> false_() {
   return constant(false);
 }
 
+namespace detail {
+
+template<typename Condition, typename TrueValue, typename FalseValue> class select_impl {
+  Condition condition_;
+  TrueValue true_value_;
+  FalseValue false_value_;
+
+public:
+  using value_type = typename TrueValue::value_type;
+  static_assert(std::is_same_v<value_type, typename FalseValue::value_type>);
+  // vectors are selected lane-wise by a mask or as a whole by a single bool.
+  static_assert(std::is_same_v<typename Condition::value_type, bool> ||
+                std::is_same_v<typename Condition::value_type, mask_type_t<value_type>>);
+
+  select_impl(Condition cnd, TrueValue tv, FalseValue fv)
+      : condition_(std::move(cnd)), true_value_(std::move(tv)), false_value_(std::move(fv)) {}
+
+  llvm::Value* eval() const {
+    auto& mb = *module_builder::current_builder();
+    auto v = mb.ir_builder().CreateSelect(condition_.eval(), true_value_.eval(), false_value_.eval());
+    // keeps the backend from turning the select back into a branch.
+    if (auto inst = llvm::dyn_cast<llvm::Instruction>(v)) {
+      inst->setMetadata(llvm::LLVMContext::MD_unpredictable, llvm::MDNode::get(mb.context(), {}));
+    }
+    return v;
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, select_impl const& si) {
+    return os << '(' << si.condition_ << " ? " << si.true_value_ << " : " << si.false_value_ << ')';
+  }
+};
+
+} // namespace detail
+
+// evaluates both values and picks one of them without branching, e.g. select_(a < b, a, b). preferable to if_()
+// when the condition is unpredictable and both values are cheap to compute.
+template<typename Condition, typename TrueValue, typename FalseValue>
+requires LLVMTypeWrapper<Condition> && LLVMTypeWrapper<TrueValue> && LLVMTypeWrapper<FalseValue>
+inline auto select_(Condition cnd, TrueValue tv, FalseValue fv) {
+  return detail::select_impl<Condition, TrueValue, FalseValue>(std::move(cnd), std::move(tv), std::move(fv));
+}
+
 inline void return_() {
   auto& mb = *module_builder::current_builder();
   auto line_no = mb.source_code_.add_line("return;");
@@ -252,7 +661,7 @@ inline void return_() {
 template<typename Value> inline void return_(Value v) {
   auto& mb = *module_builder::current_builder();
   mb.exited_block_ = true;
-  auto line_no = mb.source_code_.add_line(fmt::format("return {};", v));
+  auto line_no = mb.source_code_.add_line([&] { return fmt::format("return {};", v); });
   mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
   mb.ir_builder().CreateRet(v.eval());
 }
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+namespace codegen {
+
+struct function_statistics {
+  std::string name;
+  size_t instructions = 0;
+  size_t basic_blocks = 0;
+};
+
+// where the compilation of a single module spent its time. code generated later, by lazy compilation or tier-up, is
+// added to the report of the module it belongs to.
+struct compile_report {
+  // from the creation of the module_builder until build().
+  std::chrono::nanoseconds ir_generation{0};
+  std::chrono::nanoseconds optimization{0};
+  // instruction selection and object emission.
+  std::chrono::nanoseconds code_generation{0};
+  // loading, relocating and finalizing the objects.
+  std::chrono::nanoseconds linking{0};
+  // symbol lookups through module::get_address(). this includes any compilation triggered by the lookup.
+  std::chrono::nanoseconds symbol_lookup{0};
+
+  size_t object_size = 0;
+  // code and data sections loaded into memory.
+  size_t loaded_size = 0;
+  size_t symbol_lookups = 0;
+
+  std::vector<function_statistics> functions;
+};
+
+// totals over all modules built by a compiler_context.
+struct compile_counters {
+  uint64_t modules = 0;
+  uint64_t functions = 0;
+  uint64_t instructions = 0;
+  uint64_t basic_blocks = 0;
+  uint64_t object_size = 0;
+  uint64_t loaded_size = 0;
+  uint64_t symbol_lookups = 0;
+
+  std::chrono::nanoseconds ir_generation{0};
+  std::chrono::nanoseconds optimization{0};
+  std::chrono::nanoseconds code_generation{0};
+  std::chrono::nanoseconds linking{0};
+  std::chrono::nanoseconds symbol_lookup{0};
+};
+
+namespace detail {
+
+enum class compile_phase {
+  ir_generation,
+  optimization,
+  code_generation,
+  linking,
+  symbol_lookup,
+};
+
+inline std::vector<function_statistics> get_function_statistics(llvm::Module const& module) {
+  auto functions = std::vector<function_statistics>{};
+  for (auto& fn : module) {
+    if (fn.isDeclaration()) { continue; }
+    auto& stats = functions.emplace_back(function_statistics{fn.getName().str(), 0, fn.size()});
+    for (auto& bb : fn) { stats.instructions += bb.size(); }
+  }
+  return functions;
+}
+
+class compile_statistics {
+  std::atomic<uint64_t> modules_{0};
+  std::atomic<uint64_t> functions_{0};
+  std::atomic<uint64_t> instructions_{0};
+  std::atomic<uint64_t> basic_blocks_{0};
+  std::atomic<uint64_t> object_size_{0};
+  std::atomic<uint64_t> loaded_size_{0};
+  std::atomic<uint64_t> symbol_lookups_{0};
+
+  // nanoseconds, indexed by compile_phase.
+  std::atomic<uint64_t> phases_[5] = {};
+
+public:
+  void add_module(std::vector<function_statistics> const& functions) {
+    modules_++;
+    functions_ += functions.size();
+    for (auto& fn : functions) {
+      instructions_ += fn.instructions;
+      basic_blocks_ += fn.basic_blocks;
+    }
+  }
+
+  void add_time(compile_phase phase, std::chrono::nanoseconds duration) {
+    phases_[static_cast<size_t>(phase)] += duration.count();
+    if (phase == compile_phase::symbol_lookup) { symbol_lookups_++; }
+  }
+
+  void add_object(size_t size) { object_size_ += size; }
+
+  void add_loaded(size_t size) { loaded_size_ += size; }
+
+  compile_counters get() const {
+    auto phase = [&](compile_phase p) { return std::chrono::nanoseconds(phases_[static_cast<size_t>(p)].load()); };
+    return compile_counters{modules_.load(),
+                            functions_.load(),
+                            instructions_.load(),
+                            basic_blocks_.load(),
+                            object_size_.load(),
+                            loaded_size_.load(),
+                            symbol_lookups_.load(),
+                            phase(compile_phase::ir_generation),
+                            phase(compile_phase::optimization),
+                            phase(compile_phase::code_generation),
+                            phase(compile_phase::linking),
+                            phase(compile_phase::symbol_lookup)};
+  }
+};
+
+// report of a single module. everything recorded here is also added to the totals of the compiler_context.
+class module_statistics {
+  compile_statistics* totals_;
+
+  mutable std::mutex mutex_;
+  compile_report report_;
+
+public:
+  explicit module_statistics(compile_statistics& totals) : totals_(&totals) {}
+
+  void set_functions(std::vector<function_statistics> functions) {
+    totals_->add_module(functions);
+    auto lock = std::lock_guard(mutex_);
+    report_.functions = std::move(functions);
+  }
+
+  void add_time(compile_phase phase, std::chrono::nanoseconds duration) {
+    totals_->add_time(phase, duration);
+    auto lock = std::lock_guard(mutex_);
+    switch (phase) {
+    case compile_phase::ir_generation: report_.ir_generation += duration; break;
+    case compile_phase::optimization: report_.optimization += duration; break;
+    case compile_phase::code_generation: report_.code_generation += duration; break;
+    case compile_phase::linking: report_.linking += duration; break;
+    case compile_phase::symbol_lookup:
+      report_.symbol_lookup += duration;
+      report_.symbol_lookups++;
+      break;
+    }
+  }
+
+  void add_object(size_t size) {
+    totals_->add_object(size);
+    auto lock = std::lock_guard(mutex_);
+    report_.object_size += size;
+  }
+
+  void add_loaded(size_t size) {
+    totals_->add_loaded(size);
+    auto lock = std::lock_guard(mutex_);
+    report_.loaded_size += size;
+  }
+
+  compile_report get() const {
+    auto lock = std::lock_guard(mutex_);
+    return report_;
+  }
+};
+
+// the compile and link layers see only the module or the object they are processing. this carries the statistics
+// of the module the code belongs to, together with the time the current phase has started, from one layer to the
+// next.
+class pending_phases {
+  using clock = std::chrono::steady_clock;
+
+  std::mutex mutex_;
+  std::unordered_map<void const*, std::pair<std::shared_ptr<module_statistics>, clock::time_point>> pending_;
+
+public:
+  void start(void const* key, std::shared_ptr<module_statistics> statistics) {
+    auto lock = std::lock_guard(mutex_);
+    pending_[key] = {std::move(statistics), clock::now()};
+  }
+
+  // records the time since start() as the given phase.
+  std::shared_ptr<module_statistics> finish(void const* key, compile_phase phase) {
+    auto now = clock::now();
+    auto statistics = [&] {
+      auto lock = std::lock_guard(mutex_);
+      auto it = pending_.find(key);
+      if (it == pending_.end()) { return std::pair<std::shared_ptr<module_statistics>, clock::time_point>{}; }
+      auto statistics = std::move(it->second);
+      pending_.erase(it);
+      return statistics;
+    }();
+    if (statistics.first) { statistics.first->add_time(phase, now - statistics.second); }
+    return std::move(statistics.first);
+  }
+
+  // drops the phase without recording it, e.g. if it has failed.
+  void discard(void const* key) {
+    auto lock = std::lock_guard(mutex_);
+    pending_.erase(key);
+  }
+};
+
+// compiled object, whose linking is a pending phase keyed by the object itself. the phase is discarded together with
+// the object if linking fails, so that it is never picked up by an object allocated later at the same address.
+class pending_object final : public llvm::MemoryBuffer {
+  std::unique_ptr<llvm::MemoryBuffer> object_;
+  pending_phases* phases_;
+
+public:
+  pending_object(std::unique_ptr<llvm::MemoryBuffer> object, pending_phases& phases)
+      : object_(std::move(object)), phases_(&phases) {
+    init(object_->getBufferStart(), object_->getBufferEnd(), false);
+  }
+
+  ~pending_object() override { phases_->discard(this); }
+
+  llvm::StringRef getBufferIdentifier() const override { return object_->getBufferIdentifier(); }
+  BufferKind getBufferKind() const override { return object_->getBufferKind(); }
+};
+
+} // namespace detail
+
+} // namespace codegen
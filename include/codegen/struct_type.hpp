@@ -3,6 +3,8 @@
 #include "module_builder.hpp"
 #include "types.hpp"
 
+#include <cctype>
+#include <string>
 #include <vector>
 
 namespace codegen {
@@ -61,12 +63,26 @@ template<typename... Args> struct type<codegen::Struct<Args...>> {
   using struct_type = codegen::Struct<Args...>;
   static constexpr size_t alignment = alignof(codegen::Struct<Args...>);
   static llvm::DIType* dbg() {
-    return codegen::module_builder::current_builder()->dbg_builder_.createPointerType(
+    return codegen::module_builder::current_builder()->debug_builder().createPointerType(
         type<int*>::dbg(), sizeof(codegen::Struct<Args...>) * 8);
   }
   static llvm::Type* llvm() { return Struct<Args...>::llvm(); }
   static std::string name() { return "StructType"; }
+  // opaque in generated headers, which can only pass structs by pointer. the name is derived from the members, so
+  // that different structs get different types.
+  static std::string cxx_name(std::string const& declarator = {}) {
+    auto name = std::string("struct codegen_struct");
+    for (auto& member : {type<Args>::name()...}) {
+      name += '_';
+      for (auto c : member) { name += c == '*' ? 'p' : std::isalnum(static_cast<unsigned char>(c)) ? c : '_'; }
+    }
+    return cxx_combine(name, declarator);
+  }
 };
+
+template<typename... Args> struct is_cxx_declarable<codegen::Struct<Args...>> : std::false_type {};
+template<typename... Args> struct is_cxx_declarable<codegen::Struct<Args...>*> : std::true_type {};
+template<typename... Args> struct is_cxx_declarable<codegen::Struct<Args...> const*> : std::true_type {};
 } // namespace detail
 
 } // namespace codegen
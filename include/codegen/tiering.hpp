@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include <fmt/format.h>
+
+#include "optimizer.hpp"
+#include "utils.hpp"
+
+namespace codegen::detail {
+
+// host function called by the baseline code of a function once it becomes hot.
+inline constexpr char const* tier_up_function_name = "codegen.tier_up";
+
+// state of a single function of a tiered module. its address is baked into the baseline code of the function.
+struct tiered_function {
+  std::string name;
+  std::string stub_name;
+  std::atomic<uint64_t> calls{0};
+  std::function<void()> on_hot;
+};
+
+inline void tier_up(void* fn) {
+  static_cast<tiered_function*>(fn)->on_hot();
+}
+
+inline std::string baseline_name(std::string const& name) {
+  return name + "$tier0";
+}
+
+inline std::string optimized_name(std::string const& name) {
+  return name + "$tier2";
+}
+
+// the optimized code of a function is compiled in a module of its own, in which the private and internal globals and
+// functions it refers to, e.g. constant tables or runtime library helpers, become declarations. they are given unique
+// hidden names before the baseline code is compiled, so that those declarations resolve to the baseline definitions.
+inline void externalize_local_symbols(llvm::Module& module) {
+  for (auto& gv : module.global_values()) {
+    if (!gv.hasLocalLinkage() || gv.isDeclaration()) { continue; }
+    gv.setName(fmt::format("{}$local{}", gv.getName().str(), id_counter++));
+    gv.setLinkage(llvm::GlobalValue::ExternalLinkage);
+    gv.setVisibility(llvm::GlobalValue::HiddenVisibility);
+  }
+}
+
+// renames the bodies of the given functions to their baseline names and makes all calls go through the original
+// names, which are bound to the stubs. each body counts its calls and invokes tier_up() when the count reaches the
+// threshold.
+inline void instrument_for_tiering(llvm::Module& module, std::vector<std::unique_ptr<tiered_function>> const& functions,
+                                   uint64_t threshold) {
+  auto& context = module.getContext();
+  auto tier_up_fn = module.getOrInsertFunction(
+      tier_up_function_name, llvm::FunctionType::get(llvm::Type::getVoidTy(context),
+                                                     {llvm::Type::getInt8PtrTy(context)}, false));
+
+  for (auto& tf : functions) {
+    auto fn = module.getFunction(tf->name);
+    fn->setName(baseline_name(tf->name));
+    auto stub = llvm::Function::Create(fn->getFunctionType(), llvm::GlobalValue::ExternalLinkage, tf->name, module);
+    fn->replaceAllUsesWith(stub);
+
+    auto& entry = fn->getEntryBlock();
+    auto body = entry.splitBasicBlock(entry.getFirstInsertionPt(), "tier0_body");
+    entry.getTerminator()->eraseFromParent();
+    auto tier_up_block = llvm::BasicBlock::Create(context, "tier_up", fn, body);
+
+    auto builder = llvm::IRBuilder<>(&entry);
+    auto counter = builder.CreateIntToPtr(builder.getInt64(reinterpret_cast<uintptr_t>(&tf->calls)),
+                                          builder.getInt64Ty()->getPointerTo());
+    auto calls = builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, counter, builder.getInt64(1),
+                                         llvm::AtomicOrdering::Monotonic);
+    auto hot = builder.CreateICmpEQ(calls, builder.getInt64(threshold - 1));
+    auto weight = static_cast<uint32_t>(std::min<uint64_t>(threshold, std::numeric_limits<uint32_t>::max()));
+    builder.CreateCondBr(hot, tier_up_block, body, llvm::MDBuilder(context).createBranchWeights(1, weight));
+
+    builder.SetInsertPoint(tier_up_block);
+    builder.CreateCall(tier_up_fn, {builder.CreateIntToPtr(builder.getInt64(reinterpret_cast<uintptr_t>(tf.get())),
+                                                           builder.getInt8PtrTy())});
+    builder.CreateBr(body);
+  }
+
+  module.addModuleFlag(llvm::Module::Override, optimization_level_flag,
+                       static_cast<uint32_t>(optimization_level::O0));
+  module.addModuleFlag(llvm::Module::Override, fast_codegen_flag, uint32_t(1));
+}
+
+// extracts a single function from the original, uninstrumented module, to be compiled at O3. calls to other
+// functions of the module still go through their stubs.
+inline std::unique_ptr<llvm::Module> extract_for_tier_up(llvm::Module const& original, std::string const& name) {
+  auto vmap = llvm::ValueToValueMapTy{};
+  auto module =
+      llvm::CloneModule(original, vmap, [&](llvm::GlobalValue const* gv) { return gv->getName() == name; });
+  module->getFunction(name)->setName(optimized_name(name));
+  module->addModuleFlag(llvm::Module::Override, optimization_level_flag,
+                        static_cast<uint32_t>(optimization_level::O3));
+  return module;
+}
+
+} // namespace codegen::detail
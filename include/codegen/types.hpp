@@ -56,7 +56,12 @@ concept LLVMPointerType = LLVMIntegralPointerType<T> || LLVMFloatingPointerType<
 template<typename T>
 concept LLVMArrayType = std::is_array_v<T>&& std::extent_v<T> != 0 && LLVMPODType<std::remove_all_extents_t<T>>;
 
-template<typename T> concept LLVMType = LLVMPODType<T> || LLVMPointerType<T> || LLVMArrayType<T>;
+template<typename T>
+concept LLVMVectorType = detail::vector_traits<T>::is_vector &&
+                         LLVMArithmeticType<typename detail::vector_traits<T>::element_type>;
+
+template<typename T>
+concept LLVMType = LLVMPODType<T> || LLVMPointerType<T> || LLVMArrayType<T> || LLVMVectorType<T>;
 
 template<typename T> concept LLVMTypeWrapper = requires(T t) {
   typename T::value_type;
@@ -124,13 +129,19 @@ template<typename T> concept IsValue = requires(T t) {
   detail::is_instance<T, value>{};
 };
 
-template<typename T> concept IntegralValue = IsValue<T>&& LLVMIntegralType<typename T::value_type>;
+// integral, floating and arithmetic values are either scalars or vectors with lanes of such type.
+template<typename T>
+concept IntegralValue = IsValue<T>&& LLVMIntegralType<detail::element_type_t<typename T::value_type>>;
 
-template<typename T> concept FloatingValue = IsValue<T>&& LLVMFloatingType<typename T::value_type>;
+template<typename T>
+concept FloatingValue = IsValue<T>&& LLVMFloatingType<detail::element_type_t<typename T::value_type>>;
 
 template<typename T> concept PointerValue = IsValue<T>&& LLVMPointerType<typename T::value_type>;
 
-template<typename T> concept ArithmeticValue = IsValue<T>&& LLVMArithmeticType<typename T::value_type>;
+template<typename T>
+concept ArithmeticValue = IsValue<T>&& LLVMArithmeticType<detail::element_type_t<typename T::value_type>>;
+
+template<typename T> concept VectorValue = IsValue<T>&& LLVMVectorType<typename T::value_type>;
 
 } // namespace codegen
 
@@ -161,6 +172,7 @@ template<typename ReturnType, typename... Arguments> class function_builder<Retu
     auto name = "arg" + std::to_string(idx);
     it->setName(name);
 
+    if (!mb.debug_info_enabled()) { return; }
     auto& debug_builder = mb.debug_builder();
 
     auto dbg_arg = debug_builder.createParameterVariable(mb.source_code_.debug_scope(), name, idx + 1,
@@ -176,12 +188,14 @@ template<typename ReturnType, typename... Arguments> class function_builder<Retu
                     llvm::Function::arg_iterator args) {
     auto& mb = *codegen::module_builder::current_builder();
 
-    auto str = std::stringstream{};
-    str << type<ReturnType>::name() << " " << name << "(";
-    (void)(str << ...
-               << (type<Arguments>::name() + " arg" + std::to_string(Idx) + (Idx + 1 == sizeof...(Idx) ? "" : ", ")));
-    str << ") {";
-    mb.source_code_.add_line(str.str());
+    mb.source_code_.add_line([&] {
+      auto str = std::stringstream{};
+      str << type<ReturnType>::name() << " " << name << "(";
+      (void)(str << ...
+                 << (type<Arguments>::name() + " arg" + std::to_string(Idx) + (Idx + 1 == sizeof...(Idx) ? "" : ", ")));
+      str << ") {";
+      return str.str();
+    });
     mb.source_code_.enter_scope();
 
     [[maybe_unused]] auto _ = {0, (prepare_argument<Arguments>(args, Idx), 0)...};
@@ -192,6 +206,14 @@ template<typename ReturnType, typename... Arguments> class function_builder<Retu
   }
 
 public:
+  static function_signature signature(std::string const& name) {
+    return [&]<size_t... Idx>(std::index_sequence<Idx...>) {
+      return function_signature{name, type<ReturnType>::cxx_name(),
+                                {type<Arguments>::cxx_name(fmt::format("arg{}", Idx))...},
+                                is_cxx_declarable<ReturnType>::value && (is_cxx_declarable<Arguments>::value && ...)};
+    }(std::index_sequence_for<Arguments...>{});
+  }
+
   template<typename FunctionBuilder>
   function_ref<ReturnType, Arguments...> operator()(std::string const& name, FunctionBuilder&& fb) {
     auto& mb = *codegen::module_builder::current_builder();
@@ -229,6 +251,7 @@ class jit_function_builder {
       auto name = "arg" + std::to_string(idx);
       it->setName(name);
 
+      if (!mb.debug_info_enabled()) { continue; }
       auto dbg_arg = debug_builder.createParameterVariable(mb.source_code_.debug_scope(), name, idx + 1,
                                                            mb.source_code_.debug_file(), mb.source_code_.current_line(),
                                                            type_reverse_lookup::dbg(it->getType()));
@@ -253,18 +276,19 @@ public:
     auto block = llvm::BasicBlock::Create(mb.context(), "entry", fn);
     mb.ir_builder().SetInsertPoint(block);
 
-    auto str = std::stringstream{};
-    str << type_reverse_lookup::name(func_type->getReturnType()) << " " << name << "(";
-    auto params = func_type->params();
-    for (size_t i = 0; i < params.size(); i++) {
-      str << type_reverse_lookup::name(params[i]) + " arg" + std::to_string(i);
-      if (i != params.size() - 1) {
-        str << ", ";
+    mb.source_code_.add_line([&] {
+      auto str = std::stringstream{};
+      str << type_reverse_lookup::name(func_type->getReturnType()) << " " << name << "(";
+      auto params = func_type->params();
+      for (size_t i = 0; i < params.size(); i++) {
+        str << type_reverse_lookup::name(params[i]) + " arg" + std::to_string(i);
+        if (i != params.size() - 1) {
+          str << ", ";
+        }
       }
-    }
-    str << ") {";
-
-    mb.source_code_.add_line(str.str());
+      str << ") {";
+      return str.str();
+    });
     mb.source_code_.enter_scope();
 
     prepare_arguments(fn);
@@ -389,7 +413,11 @@ auto module_builder::create_function(std::string const& name, FunctionBuilder&&
   assert(module_builder::current_builder() == this || !module_builder::current_builder());
   exited_block_ = false;
   auto fn_ref = detail::function_builder<FunctionType>{}(name, fb);
-  fn_ref.set_function_attribute({"target-cpu", llvm::sys::getHostCPUName()});
+  fn_ref.set_function_attribute({"target-cpu", compiler_->target_cpu()});
+  if (auto features = compiler_->target_features(); !features.empty()) {
+    fn_ref.set_function_attribute({"target-features", features});
+  }
+  signatures_.emplace_back(detail::function_builder<FunctionType>::signature(name));
   return fn_ref;
 }
 
@@ -412,8 +440,14 @@ auto module_builder::declare_external_function(std::string const& name, Function
   return fn_ref;
 }
 
+template<typename FunctionType> auto module_builder::declare_runtime_function(std::string const& name) {
+  assert(module_builder::current_builder() == this || !module_builder::current_builder());
+  return detail::function_declaration_builder<FunctionType>{}(name);
+}
+
 template<typename ReturnType, typename... Arguments>
 llvm::DISubprogram* module_builder::source_code_generator::enter_function_scope(std::string const& function_name) {
+  if (!enabled_) { return nullptr; }
   std::vector<llvm::Metadata*> dbg_types = {detail::type<ReturnType>::dbg(), detail::type<Arguments>::dbg()...};
   auto dbg_fn_type = dbg_builder_.createSubroutineType(dbg_builder_.getOrCreateTypeArray(dbg_types));
   auto dbg_fn_scope = dbg_builder_.createFunction(
@@ -426,6 +460,7 @@ llvm::DISubprogram* module_builder::source_code_generator::enter_function_scope(
 
 llvm::DISubprogram*
 module_builder::source_code_generator::jit_enter_function_scope(std::string const& function_name, llvm::FunctionType* func_type) {
+  if (!enabled_) { return nullptr; }
   auto params = func_type->params();
   llvm::SmallVector<llvm::Metadata*> dbg_types(params.size() + 1);
 
@@ -1,5 +1,15 @@
 #pragma once
 
+namespace codegen {
+
+// simd vector of N lanes of T. value<vec<T, N>> is an llvm fixed vector, arithmetic and comparisons work lane-wise.
+template<typename T, size_t N> struct vec {
+  using element_type = T;
+  static constexpr size_t size = N;
+};
+
+} // namespace codegen
+
 namespace codegen::detail {
 
 // helper function
@@ -8,6 +18,39 @@ template<class, template<class> class> struct is_instance : public std::false_ty
 
 template<class T, template<class> class U> struct is_instance<U<T>, U> : public std::true_type {};
 
+// scalars are treated as vectors of a single lane, so that operations can choose instructions by the lane type.
+template<typename T> struct vector_traits {
+  static constexpr bool is_vector = false;
+  using element_type = T;
+  using mask_type = bool;
+};
+
+template<typename T, size_t N> struct vector_traits<vec<T, N>> {
+  static constexpr bool is_vector = true;
+  using element_type = T;
+  using mask_type = vec<bool, N>;
+};
+
+template<typename T> using element_type_t = typename vector_traits<T>::element_type;
+
+// type of the result of a comparison of values of type T.
+template<typename T> using mask_type_t = typename vector_traits<T>::mask_type;
+
+// c++ declaration of declarator, e.g. *arg0 or (*arg0)[4], with the given type specifier. cxx_name() of each type
+// builds the declarator outwards, so that the name ends up where c++ expects it.
+inline std::string cxx_combine(std::string const& specifier, std::string const& declarator) {
+  if (specifier.empty()) { return declarator; }
+  if (declarator.empty() || declarator.front() == '*') { return specifier + declarator; }
+  return specifier + ' ' + declarator;
+}
+
+// whether the type can appear in the signature of a function declared in a generated c++ header.
+template<typename T> struct is_cxx_declarable : std::true_type {};
+template<typename T> struct is_cxx_declarable<T*> : is_cxx_declarable<std::remove_cv_t<T>> {};
+template<typename T, size_t N> struct is_cxx_declarable<T[N]> : is_cxx_declarable<T> {};
+// vector_size does not accept bool, and masks have no memory layout c++ could rely on.
+template<size_t N> struct is_cxx_declarable<vec<bool, N>> : std::false_type {};
+
 // `typename` here could be change to LLVMType but that would cause clang to complain because LLVMType is
 // more specialized.
 
@@ -63,6 +106,9 @@ template<typename Type> struct type {
     return llvm::Type::getIntNTy(codegen::module_builder::current_builder()->context(), sizeof(Type) * 8);
   }
   static std::string name() { return fmt::format("{}{}", std::is_signed_v<Type> ? 'i' : 'u', sizeof(Type) * 8); }
+  static std::string cxx_name(std::string const& declarator = {}) {
+    return cxx_combine(fmt::format("{}int{}_t", std::is_signed_v<Type> ? "" : "u", sizeof(Type) * 8), declarator);
+  }
 };
 
 template<> struct type<void> {
@@ -70,6 +116,7 @@ template<> struct type<void> {
   static llvm::DIType* dbg() { return nullptr; }
   static llvm::Type* llvm() { return llvm::Type::getVoidTy(codegen::module_builder::current_builder()->context()); }
   static std::string name() { return "void"; }
+  static std::string cxx_name(std::string const& declarator = {}) { return cxx_combine("void", declarator); }
 };
 
 template<> struct type<bool> {
@@ -80,6 +127,7 @@ template<> struct type<bool> {
   }
   static llvm::Type* llvm() { return llvm::Type::getInt1Ty(codegen::module_builder::current_builder()->context()); }
   static std::string name() { return "bool"; }
+  static std::string cxx_name(std::string const& declarator = {}) { return cxx_combine("bool", declarator); }
 };
 
 template<> struct type<std::byte> {
@@ -90,6 +138,7 @@ template<> struct type<std::byte> {
   }
   static llvm::Type* llvm() { return llvm::Type::getInt8Ty(codegen::module_builder::current_builder()->context()); }
   static std::string name() { return "byte"; }
+  static std::string cxx_name(std::string const& declarator = {}) { return cxx_combine("std::byte", declarator); }
 };
 
 template<> struct type<float> {
@@ -100,6 +149,7 @@ template<> struct type<float> {
   }
   static llvm::Type* llvm() { return llvm::Type::getFloatTy(codegen::module_builder::current_builder()->context()); }
   static std::string name() { return "f32"; }
+  static std::string cxx_name(std::string const& declarator = {}) { return cxx_combine("float", declarator); }
 };
 
 template<> struct type<double> {
@@ -110,6 +160,7 @@ template<> struct type<double> {
   }
   static llvm::Type* llvm() { return llvm::Type::getDoubleTy(codegen::module_builder::current_builder()->context()); }
   static std::string name() { return "f64"; }
+  static std::string cxx_name(std::string const& declarator = {}) { return cxx_combine("double", declarator); }
 };
 
 template<typename Type> struct type<Type*> {
@@ -120,6 +171,14 @@ template<typename Type> struct type<Type*> {
   }
   static llvm::Type* llvm() { return type<std::remove_cv_t<Type>>::llvm()->getPointerTo(); }
   static std::string name() { return type<std::remove_cv_t<Type>>::name() + '*'; }
+  static std::string cxx_name(std::string const& declarator = {}) {
+    auto qualifier = std::string(std::is_const_v<Type> ? "const" : "");
+    if constexpr (std::is_array_v<Type>) {
+      return type<std::remove_cv_t<Type>>::cxx_name(cxx_combine(qualifier, "(*" + declarator + ")"));
+    } else {
+      return type<std::remove_cv_t<Type>>::cxx_name(cxx_combine(qualifier, cxx_combine("*", declarator)));
+    }
+  }
 };
 
 // array type
@@ -133,6 +192,24 @@ template<typename Type, size_t N> struct type<Type[N]> {
   }
   static llvm::Type* llvm() { return llvm::ArrayType::get(type<Type>::llvm(), N); }
   static std::string name() { return fmt::format("{}[{}]", type<Type>::name(), N); }
+  static std::string cxx_name(std::string const& declarator = {}) {
+    return type<Type>::cxx_name(fmt::format("{}[{}]", declarator, N));
+  }
+};
+
+template<typename Type, size_t N> struct type<vec<Type, N>> {
+  static constexpr size_t alignment = alignof(Type);
+  static llvm::DIType* dbg() {
+    auto& debug_builder = codegen::module_builder::current_builder()->debug_builder();
+    auto subscripts = debug_builder.getOrCreateArray({debug_builder.getOrCreateSubrange(0, N)});
+    return debug_builder.createVectorType(sizeof(Type) * N * 8, alignof(Type) * 8, type<Type>::dbg(), subscripts);
+  }
+  static llvm::Type* llvm() { return llvm::FixedVectorType::get(type<Type>::llvm(), N); }
+  static std::string name() { return fmt::format("{}x{}", type<Type>::name(), N); }
+  static std::string cxx_name(std::string const& declarator = {}) {
+    return cxx_combine(fmt::format("{} __attribute__((vector_size({})))", type<Type>::cxx_name(), sizeof(Type) * N),
+                           declarator);
+  }
 };
 
 } // namespace codegen::detail
@@ -41,7 +41,8 @@ public:
         llvm::IRBuilder<>(&mb.current_function()->getEntryBlock(), mb.current_function()->getEntryBlock().begin());
     variable_ = alloca_builder.CreateAlloca(detail::type<Type>::llvm(), nullptr, name_);
 
-    auto line_no = mb.source_code_.add_line(fmt::format("{} {};", detail::type<Type>::name(), name_));
+    auto line_no = mb.source_code_.add_line([&] { return fmt::format("{} {};", detail::type<Type>::name(), name_); });
+    if (!mb.debug_info_enabled()) { return; }
     auto& debug_builder = mb.debug_builder();
     auto dbg_variable = debug_builder.createAutoVariable(
         mb.source_code_.debug_scope(), name_, mb.source_code_.debug_file(), line_no, detail::type<Type>::dbg());
@@ -62,7 +63,7 @@ public:
 
   template<typename V> void set(V const& v) requires IsValue<V>&& std::same_as<Type, typename V::value_type> {
     auto& mb = *module_builder::current_builder();
-    auto line_no = mb.source_code_.add_line(fmt::format("{} = {};", name_, v));
+    auto line_no = mb.source_code_.add_line([&] { return fmt::format("{} = {};", name_, v); });
     mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
     mb.ir_builder().CreateAlignedStore(v.eval(), variable_, llvm::MaybeAlign(detail::type<Type>::alignment));
   }
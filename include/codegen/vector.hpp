@@ -0,0 +1,274 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+
+#include <fmt/format.h>
+
+#include "module_builder.hpp"
+#include "types.hpp"
+
+namespace codegen {
+
+namespace detail {
+
+// unlike arithmetic and comparisons, which are evaluated where their result is used, these operations are emitted
+// immediately and are given a line of their own in the generated source.
+template<typename Type, typename Describe, typename Build>
+value<Type> emit_vector_operation(Describe&& describe, Build&& build) {
+  auto& mb = *module_builder::current_builder();
+  auto id = fmt::format("val{}", id_counter++);
+  auto line_no = mb.source_code_.add_line([&] { return fmt::format("{} = {};", id, describe()); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+  return value<Type>{build(mb.ir_builder()), id};
+}
+
+template<typename Lanes> std::string format_lanes(Lanes const& lanes) {
+  auto str = std::string{};
+  for (auto lane : lanes) { str += fmt::format("{}{}", str.empty() ? "" : ", ", lane); }
+  return "{" + str + "}";
+}
+
+// floating point reductions are sequential by default, allowing reassociation lets them be done in a tree.
+inline llvm::Value* unordered_reduction(llvm::CallInst* reduction) {
+  auto flags = llvm::FastMathFlags{};
+  flags.setAllowReassoc();
+  reduction->setFastMathFlags(flags);
+  return reduction;
+}
+
+template<size_t N>
+using bitmask_type = std::conditional_t<
+    N <= 8, uint8_t, std::conditional_t<N <= 16, uint16_t, std::conditional_t<N <= 32, uint32_t, uint64_t>>>;
+
+template<typename T> concept ScalarIntegralValue = LLVMTypeWrapper<T>&& LLVMIntegralType<typename T::value_type>;
+
+template<typename T>
+concept MaskValue = VectorValue<T>&& std::same_as<typename T::value_type::element_type, bool>;
+
+} // namespace detail
+
+// vector with all N lanes set to v.
+template<size_t N, typename Value>
+requires LLVMTypeWrapper<Value> && LLVMArithmeticType<typename Value::value_type>
+inline value<vec<typename Value::value_type, N>> splat(Value v) {
+  return detail::emit_vector_operation<vec<typename Value::value_type, N>>(
+      [&] { return fmt::format("splat({})", v); },
+      [&](auto& builder) { return builder.CreateVectorSplat(N, v.eval()); });
+}
+
+template<VectorValue Vector> inline value<typename Vector::value_type::element_type> extract(Vector v, unsigned lane) {
+  assert(lane < Vector::value_type::size);
+  return detail::emit_vector_operation<typename Vector::value_type::element_type>(
+      [&] { return fmt::format("{}[{}]", v, lane); },
+      [&](auto& builder) { return builder.CreateExtractElement(v.eval(), uint64_t(lane)); });
+}
+
+template<VectorValue Vector, detail::ScalarIntegralValue Lane>
+inline value<typename Vector::value_type::element_type> extract(Vector v, Lane lane) {
+  return detail::emit_vector_operation<typename Vector::value_type::element_type>(
+      [&] { return fmt::format("{}[{}]", v, lane); },
+      [&](auto& builder) { return builder.CreateExtractElement(v.eval(), lane.eval()); });
+}
+
+// copy of the vector with the given lane replaced.
+template<VectorValue Vector, typename Value>
+requires std::same_as<typename Vector::value_type::element_type, typename Value::value_type>
+inline value<typename Vector::value_type> insert(Vector v, unsigned lane, Value x) {
+  assert(lane < Vector::value_type::size);
+  return detail::emit_vector_operation<typename Vector::value_type>(
+      [&] { return fmt::format("insert({}, {}, {})", v, lane, x); },
+      [&](auto& builder) { return builder.CreateInsertElement(v.eval(), x.eval(), uint64_t(lane)); });
+}
+
+template<VectorValue Vector, detail::ScalarIntegralValue Lane, typename Value>
+requires std::same_as<typename Vector::value_type::element_type, typename Value::value_type>
+inline value<typename Vector::value_type> insert(Vector v, Lane lane, Value x) {
+  return detail::emit_vector_operation<typename Vector::value_type>(
+      [&] { return fmt::format("insert({}, {}, {})", v, lane, x); },
+      [&](auto& builder) { return builder.CreateInsertElement(v.eval(), x.eval(), lane.eval()); });
+}
+
+// lane i of the result is lane lanes[i] of the concatenation of a and b, -1 leaves it undefined. the number of
+// lanes of the result is the size of the list, e.g. shuffle(a, b, {0, 8, 1, 9}).
+template<VectorValue A, VectorValue B, size_t M>
+requires std::same_as<typename A::value_type, typename B::value_type>
+inline value<vec<typename A::value_type::element_type, M>> shuffle(A a, B b, int const (&lanes)[M]) {
+  return detail::emit_vector_operation<vec<typename A::value_type::element_type, M>>(
+      [&] { return fmt::format("shuffle({}, {}, {})", a, b, detail::format_lanes(lanes)); },
+      [&](auto& builder) { return builder.CreateShuffleVector(a.eval(), b.eval(), llvm::ArrayRef<int>(lanes)); });
+}
+
+template<VectorValue Vector, size_t M>
+inline value<vec<typename Vector::value_type::element_type, M>> shuffle(Vector v, int const (&lanes)[M]) {
+  return detail::emit_vector_operation<vec<typename Vector::value_type::element_type, M>>(
+      [&] { return fmt::format("shuffle({}, {})", v, detail::format_lanes(lanes)); },
+      [&](auto& builder) {
+        return builder.CreateShuffleVector(v.eval(), llvm::UndefValue::get(v.eval()->getType()),
+                                           llvm::ArrayRef<int>(lanes));
+      });
+}
+
+// loads N consecutive elements. the pointer needs to be aligned only as the element type.
+template<size_t N, typename Ptr>
+requires Pointer<std::decay_t<Ptr>> && LLVMArithmeticType<std::remove_cv_t<
+    std::remove_pointer_t<typename std::decay_t<Ptr>::value_type>>> &&
+    (!LLVMBoolType<std::remove_cv_t<std::remove_pointer_t<typename std::decay_t<Ptr>::value_type>>>)
+inline auto load(Ptr ptr) {
+  using element_type = std::remove_cv_t<std::remove_pointer_t<typename std::decay_t<Ptr>::value_type>>;
+  using vector_type = vec<element_type, N>;
+  auto& mb = *module_builder::current_builder();
+
+  auto id = fmt::format("val{}", detail::id_counter++);
+
+  auto line_no = mb.source_code_.add_line(
+      [&] { return fmt::format("{} = *({}*){}", id, detail::type<vector_type>::name(), ptr); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+  auto address = mb.ir_builder().CreateBitCast(ptr.eval(), detail::type<vector_type>::llvm()->getPointerTo());
+  auto v = mb.ir_builder().CreateAlignedLoad(address, llvm::MaybeAlign(detail::type<vector_type>::alignment));
+
+  if (mb.debug_info_enabled()) {
+    auto dbg_value = mb.debug_builder().createAutoVariable(
+        mb.source_code_.debug_scope(), id, mb.source_code_.debug_file(), line_no, detail::type<vector_type>::dbg());
+    mb.debug_builder().insertDbgValueIntrinsic(v, dbg_value, mb.debug_builder().createExpression(),
+                                               mb.get_debug_location(line_no), mb.ir_builder().GetInsertBlock());
+  }
+
+  return value<vector_type>{v, id};
+}
+
+// stores the lanes to consecutive elements.
+template<VectorValue Value, typename Ptr>
+requires Pointer<std::decay_t<Ptr>> &&
+    (!std::is_const_v<std::remove_pointer_t<typename std::decay_t<Ptr>::value_type>>) &&
+    std::same_as<typename Value::value_type::element_type,
+                 std::remove_pointer_t<typename std::decay_t<Ptr>::value_type>> &&
+    (!LLVMBoolType<typename Value::value_type::element_type>)
+inline void store(Value v, Ptr ptr) {
+  using vector_type = typename Value::value_type;
+  auto& mb = *module_builder::current_builder();
+
+  auto line_no =
+      mb.source_code_.add_line([&] { return fmt::format("*({}*){} = {}", detail::type<vector_type>::name(), ptr, v); });
+  mb.ir_builder().SetCurrentDebugLocation(mb.get_debug_location(line_no));
+  auto address = mb.ir_builder().CreateBitCast(ptr.eval(), detail::type<vector_type>::llvm()->getPointerTo());
+  mb.ir_builder().CreateAlignedStore(v.eval(), address, llvm::MaybeAlign(detail::type<vector_type>::alignment));
+}
+
+// horizontal reductions of all lanes. floating point sums and products are not computed in lane order.
+template<VectorValue Vector> inline value<typename Vector::value_type::element_type> reduce_add(Vector v) {
+  using element_type = typename Vector::value_type::element_type;
+  return detail::emit_vector_operation<element_type>(
+      [&] { return fmt::format("reduce_add({})", v); },
+      [&](auto& builder) -> llvm::Value* {
+        if constexpr (LLVMFloatingType<element_type>) {
+          return detail::unordered_reduction(builder.CreateFAddReduce(
+              llvm::ConstantFP::getNegativeZero(detail::type<element_type>::llvm()), v.eval()));
+        } else {
+          return builder.CreateAddReduce(v.eval());
+        }
+      });
+}
+
+template<VectorValue Vector> inline value<typename Vector::value_type::element_type> reduce_mul(Vector v) {
+  using element_type = typename Vector::value_type::element_type;
+  return detail::emit_vector_operation<element_type>(
+      [&] { return fmt::format("reduce_mul({})", v); },
+      [&](auto& builder) -> llvm::Value* {
+        if constexpr (LLVMFloatingType<element_type>) {
+          return detail::unordered_reduction(
+              builder.CreateFMulReduce(llvm::ConstantFP::get(detail::type<element_type>::llvm(), 1.0), v.eval()));
+        } else {
+          return builder.CreateMulReduce(v.eval());
+        }
+      });
+}
+
+template<VectorValue Vector> inline value<typename Vector::value_type::element_type> reduce_min(Vector v) {
+  using element_type = typename Vector::value_type::element_type;
+  return detail::emit_vector_operation<element_type>(
+      [&] { return fmt::format("reduce_min({})", v); },
+      [&](auto& builder) -> llvm::Value* {
+        if constexpr (LLVMFloatingType<element_type>) {
+          return builder.CreateFPMinReduce(v.eval());
+        } else {
+          return builder.CreateIntMinReduce(v.eval(), std::is_signed_v<element_type>);
+        }
+      });
+}
+
+template<VectorValue Vector> inline value<typename Vector::value_type::element_type> reduce_max(Vector v) {
+  using element_type = typename Vector::value_type::element_type;
+  return detail::emit_vector_operation<element_type>(
+      [&] { return fmt::format("reduce_max({})", v); },
+      [&](auto& builder) -> llvm::Value* {
+        if constexpr (LLVMFloatingType<element_type>) {
+          return builder.CreateFPMaxReduce(v.eval());
+        } else {
+          return builder.CreateIntMaxReduce(v.eval(), std::is_signed_v<element_type>);
+        }
+      });
+}
+
+template<VectorValue Vector>
+requires IntegralValue<Vector> inline value<typename Vector::value_type::element_type> reduce_and(Vector v) {
+  return detail::emit_vector_operation<typename Vector::value_type::element_type>(
+      [&] { return fmt::format("reduce_and({})", v); },
+      [&](auto& builder) { return builder.CreateAndReduce(v.eval()); });
+}
+
+template<VectorValue Vector>
+requires IntegralValue<Vector> inline value<typename Vector::value_type::element_type> reduce_or(Vector v) {
+  return detail::emit_vector_operation<typename Vector::value_type::element_type>(
+      [&] { return fmt::format("reduce_or({})", v); }, [&](auto& builder) { return builder.CreateOrReduce(v.eval()); });
+}
+
+template<VectorValue Vector>
+requires IntegralValue<Vector> inline value<typename Vector::value_type::element_type> reduce_xor(Vector v) {
+  return detail::emit_vector_operation<typename Vector::value_type::element_type>(
+      [&] { return fmt::format("reduce_xor({})", v); },
+      [&](auto& builder) { return builder.CreateXorReduce(v.eval()); });
+}
+
+// whether any or all lanes of a mask, e.g. the result of a comparison of two vectors, are set.
+template<detail::MaskValue Mask> inline value<bool> any(Mask m) {
+  return detail::emit_vector_operation<bool>([&] { return fmt::format("any({})", m); },
+                                             [&](auto& builder) { return builder.CreateOrReduce(m.eval()); });
+}
+
+template<detail::MaskValue Mask> inline value<bool> all(Mask m) {
+  return detail::emit_vector_operation<bool>([&] { return fmt::format("all({})", m); },
+                                             [&](auto& builder) { return builder.CreateAndReduce(m.eval()); });
+}
+
+// packs a mask into an integer, lane i becomes bit i. the integer is the smallest unsigned type with enough bits.
+template<detail::MaskValue Mask>
+inline value<detail::bitmask_type<Mask::value_type::size>> to_bitmask(Mask m) {
+  constexpr auto lanes = Mask::value_type::size;
+  using bitmask_type = detail::bitmask_type<lanes>;
+  static_assert(lanes <= 64);
+  return detail::emit_vector_operation<bitmask_type>(
+      [&] { return fmt::format("to_bitmask({})", m); },
+      [&](auto& builder) {
+        auto bits = builder.CreateBitCast(m.eval(), builder.getIntNTy(lanes));
+        return builder.CreateZExtOrTrunc(bits, detail::type<bitmask_type>::llvm());
+      });
+}
+
+// unpacks the N low bits of an unsigned integer into a mask, bit i becomes lane i.
+template<size_t N, detail::ScalarIntegralValue Bits>
+requires std::is_unsigned_v<typename Bits::value_type> && (sizeof(typename Bits::value_type) * 8 >= N)
+inline value<vec<bool, N>> from_bitmask(Bits b) {
+  return detail::emit_vector_operation<vec<bool, N>>(
+      [&] { return fmt::format("from_bitmask<{}>({})", N, b); },
+      [&](auto& builder) {
+        auto bits = builder.CreateZExtOrTrunc(b.eval(), builder.getIntNTy(N));
+        return builder.CreateBitCast(bits, detail::type<vec<bool, N>>::llvm());
+      });
+}
+
+} // namespace codegen
@@ -0,0 +1,177 @@
+/*
+ * Copyright © 2019 Paweł Dziepak
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "codegen/codegen.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <vector>
+
+TEST(atomic, operations) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "atomic_operations");
+
+  auto rmw = builder.create_function<int32_t(int32_t*, int32_t*)>(
+      "rmw", [](codegen::value<int32_t*> ptr, codegen::value<int32_t*> old) {
+        auto c = [](int32_t v) { return codegen::constant<int32_t>(v); };
+        codegen::store(codegen::atomic_rmw(codegen::atomic_op::add, ptr, c(10)), old);
+        codegen::store(codegen::atomic_rmw(codegen::atomic_op::sub, ptr, c(3), std::memory_order_relaxed),
+                       old + c(1));
+        codegen::store(codegen::atomic_rmw(codegen::atomic_op::and_, ptr, c(0xfe), std::memory_order_acquire),
+                       old + c(2));
+        codegen::store(codegen::atomic_rmw(codegen::atomic_op::or_, ptr, c(0x100), std::memory_order_release),
+                       old + c(3));
+        codegen::store(codegen::atomic_rmw(codegen::atomic_op::xor_, ptr, c(0x101), std::memory_order_acq_rel),
+                       old + c(4));
+        codegen::store(codegen::atomic_rmw(codegen::atomic_op::min, ptr, c(-5)), old + c(5));
+        codegen::store(codegen::atomic_rmw(codegen::atomic_op::max, ptr, c(7)), old + c(6));
+        codegen::fence(std::memory_order_acq_rel);
+        codegen::return_(codegen::atomic_rmw(codegen::atomic_op::xchg, ptr, c(42)));
+      });
+
+  auto umin = builder.create_function<uint32_t(uint32_t*, uint32_t)>(
+      "umin", [](codegen::value<uint32_t*> ptr, codegen::value<uint32_t> v) {
+        codegen::atomic_rmw(codegen::atomic_op::min, ptr, v);
+        codegen::return_(codegen::atomic_load(ptr, std::memory_order_acquire));
+      });
+
+  auto exchange = builder.create_function<int64_t(int64_t*, int64_t, int64_t)>(
+      "exchange", [](codegen::value<int64_t*> ptr, codegen::value<int64_t> expected, codegen::value<int64_t> desired) {
+        auto result = codegen::cmpxchg(ptr, expected, desired, std::memory_order_acq_rel);
+        codegen::if_(result.success, [&] { codegen::return_(codegen::constant<int64_t>(-1)); });
+        codegen::return_(result.old);
+      });
+
+  auto fadd = builder.create_function<double(double*, double)>(
+      "fadd", [](codegen::value<double*> ptr, codegen::value<double> v) {
+        codegen::atomic_rmw(codegen::atomic_op::add, ptr, v);
+        codegen::atomic_store(codegen::atomic_load(ptr, std::memory_order_relaxed) + v, ptr,
+                              std::memory_order_release);
+        codegen::return_(codegen::atomic_load(ptr));
+      });
+
+  auto module = std::move(builder).build();
+
+  auto value = int32_t(5);
+  auto old = std::array<int32_t, 7>{};
+  EXPECT_EQ(module.get_address(rmw)(&value, old.data()), 7);
+  EXPECT_EQ(old, (std::array<int32_t, 7>{5, 15, 12, 12, 0x10c, 0xd, -5}));
+  EXPECT_EQ(value, 42);
+
+  auto u = uint32_t(10);
+  EXPECT_EQ(module.get_address(umin)(&u, 20), 10u);
+  EXPECT_EQ(module.get_address(umin)(&u, 3), 3u);
+
+  auto i = int64_t(100);
+  EXPECT_EQ(module.get_address(exchange)(&i, 99, 1), 100);
+  EXPECT_EQ(i, 100);
+  EXPECT_EQ(module.get_address(exchange)(&i, 100, 1), -1);
+  EXPECT_EQ(i, 1);
+
+  auto d = 1.5;
+  EXPECT_EQ(module.get_address(fadd)(&d, 0.25), 2.0);
+}
+
+TEST(atomic, threads) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "atomic_threads");
+
+  auto count = builder.create_function<void(uint64_t*, uint64_t)>(
+      "count", [](codegen::value<uint64_t*> counter, codegen::value<uint64_t> n) {
+        codegen::for_(codegen::constant<uint64_t>(0), n, codegen::constant<uint64_t>(1), [&](codegen::value<uint64_t>) {
+          codegen::atomic_rmw(codegen::atomic_op::add, counter, codegen::constant<uint64_t>(1),
+                              std::memory_order_relaxed);
+        });
+        codegen::return_();
+      });
+
+  // increments a plain counter under a spin lock taken with cmpxchg.
+  auto locked_count = builder.create_function<void(int32_t*, int64_t*, uint64_t)>(
+      "locked_count", [](codegen::value<int32_t*> lock, codegen::value<int64_t*> counter, codegen::value<uint64_t> n) {
+        codegen::for_(codegen::constant<uint64_t>(0), n, codegen::constant<uint64_t>(1), [&](codegen::value<uint64_t>) {
+          auto owner = codegen::variable<int32_t>("owner", codegen::constant<int32_t>(1));
+          codegen::while_([&] { return owner.get() != codegen::constant<int32_t>(0); },
+                          [&] {
+                            owner.set(codegen::cmpxchg(lock, codegen::constant<int32_t>(0),
+                                                       codegen::constant<int32_t>(1), std::memory_order_acquire)
+                                          .old);
+                          });
+          codegen::store(codegen::load(counter) + codegen::constant<int64_t>(1), counter);
+          codegen::atomic_store(codegen::constant<int32_t>(0), lock, std::memory_order_release);
+        });
+        codegen::return_();
+      });
+
+  auto max = builder.create_function<void(int64_t*, int64_t const*, uint64_t)>(
+      "max", [](codegen::value<int64_t*> max, codegen::value<int64_t const*> values, codegen::value<uint64_t> n) {
+        codegen::for_(codegen::constant<uint64_t>(0), n, codegen::constant<uint64_t>(1),
+                      [&](codegen::value<uint64_t> i) {
+                        codegen::atomic_rmw(codegen::atomic_op::max, max, codegen::load(values + i),
+                                            std::memory_order_relaxed);
+                      });
+        codegen::return_();
+      });
+
+  auto module = std::move(builder).build();
+  auto count_ptr = module.get_address(count);
+  auto locked_count_ptr = module.get_address(locked_count);
+  auto max_ptr = module.get_address(max);
+
+  constexpr auto thread_count = 4;
+  constexpr auto iterations = uint64_t(100000);
+
+  auto counter = uint64_t(0);
+  auto lock = int32_t(0);
+  auto locked_counter = int64_t(0);
+  auto maximum = int64_t(-1);
+  auto values = std::vector<std::vector<int64_t>>(thread_count);
+  for (auto t = 0; t < thread_count; t++) {
+    for (auto i = 0u; i < iterations; i++) { values[t].emplace_back((i * 7919 + t * 104729) % 1000003); }
+  }
+
+  auto threads = std::vector<std::thread>{};
+  for (auto t = 0; t < thread_count; t++) {
+    threads.emplace_back([&, t] {
+      count_ptr(&counter, iterations);
+      locked_count_ptr(&lock, &locked_counter, iterations);
+      max_ptr(&maximum, values[t].data(), values[t].size());
+    });
+  }
+  for (auto& thread : threads) { thread.join(); }
+
+  auto expected_max = int64_t(-1);
+  for (auto& v : values) { expected_max = std::max(expected_max, *std::max_element(v.begin(), v.end())); }
+
+  EXPECT_EQ(counter, thread_count * iterations);
+  EXPECT_EQ(locked_counter, int64_t(thread_count * iterations));
+  EXPECT_EQ(lock, 0);
+  EXPECT_EQ(maximum, expected_max);
+}
+
+int main(int argc, char** argv) {
+  INIT_LLVM_ENV(argc, argv);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -24,6 +24,9 @@
 
 #include <gtest/gtest.h>
 
+#include <array>
+#include <numeric>
+
 TEST(builtin, memcpy) {
   auto comp = codegen::compiler_context{};
   auto builder = codegen::module_builder(comp, "memcpy");
@@ -69,6 +72,161 @@ TEST(builtin, bswap) {
   EXPECT_EQ(bswap_i32_ptr(0x12345678), 0x78563412);
 }
 
+TEST(builtin, masked_load_store) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "masked_load_store");
+
+  auto double_lanes = builder.create_function<void(int32_t*, int32_t*, uint8_t)>(
+      "double_lanes", [](codegen::value<int32_t*> in, codegen::value<int32_t*> out, codegen::value<uint8_t> bits) {
+        auto mask = codegen::from_bitmask<8>(bits);
+        auto v = codegen::builtin::masked_load(in, mask);
+        codegen::builtin::masked_store(v + v, out, mask);
+        codegen::return_();
+      });
+
+  auto or_default = builder.create_function<int32_t(int32_t*, uint8_t)>(
+      "or_default", [](codegen::value<int32_t*> in, codegen::value<uint8_t> bits) {
+        auto v = codegen::builtin::masked_load(in, codegen::from_bitmask<8>(bits),
+                                               codegen::splat<8>(codegen::constant<int32_t>(100)));
+        codegen::return_(codegen::reduce_add(v));
+      });
+
+  auto module = std::move(builder).build();
+
+  auto in = std::array<int32_t, 5>{1, 2, 3, 4, 5};
+  auto out = std::array<int32_t, 8>{};
+  out.fill(-1);
+  module.get_address(double_lanes)(in.data(), out.data(), 0b11111);
+  EXPECT_EQ(out, (std::array<int32_t, 8>{2, 4, 6, 8, 10, -1, -1, -1}));
+
+  EXPECT_EQ(module.get_address(or_default)(in.data(), 0b10101), 1 + 3 + 5 + 5 * 100);
+}
+
+TEST(builtin, gather_scatter) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "gather_scatter");
+
+  auto lookup = builder.create_function<void(int64_t*, uint32_t*, int64_t*)>(
+      "lookup", [](codegen::value<int64_t*> table, codegen::value<uint32_t*> idx, codegen::value<int64_t*> out) {
+        codegen::store(codegen::builtin::gather(table, codegen::load<4>(idx)), out);
+        codegen::return_();
+      });
+
+  auto lookup_checked = builder.create_function<void(int64_t*, int32_t*, int32_t, int64_t*)>(
+      "lookup_checked", [](codegen::value<int64_t*> table, codegen::value<int32_t*> idx, codegen::value<int32_t> size,
+                           codegen::value<int64_t*> out) {
+        auto indices = codegen::load<4>(idx);
+        auto v = codegen::builtin::gather(table, indices, indices < codegen::splat<4>(size),
+                                          codegen::splat<4>(codegen::constant<int64_t>(-1)));
+        codegen::store(v, out);
+        codegen::return_();
+      });
+
+  auto update = builder.create_function<void(int64_t*, uint16_t*, int64_t*)>(
+      "update", [](codegen::value<int64_t*> values, codegen::value<uint16_t*> idx, codegen::value<int64_t*> table) {
+        codegen::builtin::scatter(codegen::load<4>(values), table, codegen::load<4>(idx));
+        codegen::return_();
+      });
+
+  auto module = std::move(builder).build();
+
+  auto table = std::array<int64_t, 6>{10, 11, 12, 13, 14, 15};
+  auto idx = std::array<uint32_t, 4>{5, 0, 3, 3};
+  auto out = std::array<int64_t, 4>{};
+  module.get_address(lookup)(table.data(), idx.data(), out.data());
+  EXPECT_EQ(out, (std::array<int64_t, 4>{15, 10, 13, 13}));
+
+  auto checked_idx = std::array<int32_t, 4>{2, 6, 1000000, 4};
+  module.get_address(lookup_checked)(table.data(), checked_idx.data(), int32_t(table.size()), out.data());
+  EXPECT_EQ(out, (std::array<int64_t, 4>{12, -1, -1, 14}));
+
+  auto values = std::array<int64_t, 4>{-1, -2, -3, -4};
+  auto update_idx = std::array<uint16_t, 4>{4, 1, 1, 0};
+  module.get_address(update)(values.data(), update_idx.data(), table.data());
+  EXPECT_EQ(table, (std::array<int64_t, 6>{-4, -3, 12, 13, -1, 15}));
+}
+
+TEST(builtin, compress_expand) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "compress_expand");
+
+  auto filter = builder.create_function<uint32_t(int32_t*, int32_t, int32_t*)>(
+      "filter", [](codegen::value<int32_t*> in, codegen::value<int32_t> threshold, codegen::value<int32_t*> out) {
+        auto v = codegen::load<8>(in);
+        codegen::return_(codegen::builtin::compress_store(v, out, v > codegen::splat<8>(threshold)));
+      });
+
+  auto expand = builder.create_function<void(int32_t*, uint8_t, int32_t*)>(
+      "expand", [](codegen::value<int32_t*> in, codegen::value<uint8_t> bits, codegen::value<int32_t*> out) {
+        codegen::store(codegen::builtin::expand_load(in, codegen::from_bitmask<8>(bits)), out);
+        codegen::return_();
+      });
+
+  auto module = std::move(builder).build();
+
+  auto in = std::array<int32_t, 8>{7, 1, 9, 3, 8, 2, 6, 4};
+  auto out = std::array<int32_t, 8>{};
+  EXPECT_EQ(module.get_address(filter)(in.data(), 5, out.data()), 4u);
+  EXPECT_EQ((std::array<int32_t, 4>{out[0], out[1], out[2], out[3]}), (std::array<int32_t, 4>{7, 9, 8, 6}));
+
+  auto packed = std::array<int32_t, 3>{1, 2, 3};
+  module.get_address(expand)(packed.data(), 0b10010010, out.data());
+  EXPECT_EQ(out, (std::array<int32_t, 8>{0, 1, 0, 0, 2, 0, 0, 3}));
+}
+
+TEST(builtin, memset) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "memset");
+
+  auto fill = builder.create_function<void(int32_t*, uint8_t, uint64_t)>(
+      "fill", [](codegen::value<int32_t*> dst, codegen::value<uint8_t> v, codegen::value<uint64_t> n) {
+        codegen::builtin::memset(dst, v, n);
+        codegen::return_();
+      });
+
+  auto module = std::move(builder).build();
+
+  auto buffer = std::array<int32_t, 4>{1, 2, 3, 4};
+  module.get_address(fill)(buffer.data(), 0xab, 3 * sizeof(int32_t));
+  EXPECT_EQ(buffer, (std::array<int32_t, 4>{int32_t(0xabababab), int32_t(0xabababab), int32_t(0xabababab), 4}));
+}
+
+TEST(builtin, prefetch_stream_store) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "prefetch_stream_store");
+
+  auto scale = builder.create_function<void(float*, float*, uint64_t)>(
+      "scale", [](codegen::value<float*> in, codegen::value<float*> out, codegen::value<uint64_t> n) {
+        auto step = codegen::constant<uint64_t>(8);
+        codegen::for_(codegen::constant<uint64_t>(0), n, step, [&](codegen::value<uint64_t> i) {
+          codegen::builtin::prefetch(in + i, codegen::builtin::prefetch_access::read, 0);
+          auto v = codegen::load<8>(in + i);
+          codegen::builtin::stream_store(v * codegen::splat<8>(codegen::constant<float>(2)), out + i, 32);
+        });
+        codegen::return_();
+      });
+
+  auto count = builder.create_function<void(uint64_t*, uint64_t)>(
+      "count", [](codegen::value<uint64_t*> out, codegen::value<uint64_t> n) {
+        codegen::for_(codegen::constant<uint64_t>(0), n, codegen::constant<uint64_t>(1),
+                      [&](codegen::value<uint64_t> i) { codegen::builtin::stream_store(i, out + i); });
+        codegen::return_();
+      });
+
+  auto module = std::move(builder).build();
+
+  // streaming vector stores need the whole vector aligned.
+  alignas(32) auto in = std::array<float, 32>{};
+  alignas(32) auto out = std::array<float, 32>{};
+  std::iota(in.begin(), in.end(), 0.f);
+  module.get_address(scale)(in.data(), out.data(), in.size());
+  for (auto i = 0u; i < out.size(); i++) { EXPECT_EQ(out[i], 2 * in[i]); }
+
+  auto counts = std::array<uint64_t, 5>{};
+  module.get_address(count)(counts.data(), counts.size());
+  EXPECT_EQ(counts, (std::array<uint64_t, 5>{0, 1, 2, 3, 4}));
+}
+
 int main(int argc, char** argv) {
   INIT_LLVM_ENV(argc, argv);
   ::testing::InitGoogleTest(&argc, argv);
@@ -121,8 +121,8 @@ TEST(examples, tuple_i32str_less) {
   EXPECT_FALSE(less_ptr(make_tuple(1, "z").get(), make_tuple(1, "bbb").get()));
 }
 
-TEST(examples, soa_compute) {
-  auto comp = codegen::compiler_context{};
+void soa_compute(cg::optimization_level level) {
+  auto comp = codegen::compiler_context("codegen", level);
   auto builder = codegen::module_builder(comp, "soa_compute");
   // TODO: enable `const` qualifier in type system so we can avoid copying lvalues.
   // such as:
@@ -169,6 +169,18 @@ TEST(examples, soa_compute) {
   test(dist(gen), b, c);
 }
 
+TEST(examples, soa_compute) {
+  soa_compute(cg::optimization_level::O0);
+}
+
+TEST(examples, soa_compute_O2) {
+  soa_compute(cg::optimization_level::O2);
+}
+
+TEST(examples, soa_compute_O3) {
+  soa_compute(cg::optimization_level::O3);
+}
+
 TEST(examples, trivial_if) {
   auto comp = codegen::compiler_context{};
   auto builder = codegen::module_builder(comp, "trivial_if");
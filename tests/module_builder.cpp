@@ -20,9 +20,27 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include <gtest/gtest.h>
 
 #include "codegen/codegen.hpp"
+#include "codegen/struct_type.hpp"
 
 using namespace codegen::literals;
 
@@ -129,6 +147,835 @@ TEST(module_builder, cast) {
   EXPECT_EQ(u16_to_u64_ptr(-1), 0xffff);
 }
 
+TEST(module_builder, optimization_level) {
+  auto comp = codegen::compiler_context("codegen", codegen::optimization_level::O2);
+  EXPECT_EQ(comp.get_optimization_level(), codegen::optimization_level::O2);
+
+  auto builder = codegen::module_builder(comp, "optimization_level");
+  builder.set_optimization_level(codegen::optimization_level::Os);
+
+  auto sum = builder.create_function<uint32_t(uint32_t)>("sum", [](codegen::value<uint32_t> n) {
+    auto i = codegen::variable<uint32_t>("i", 0_u32);
+    auto total = codegen::variable<uint32_t>("total", 0_u32);
+    codegen::while_([&] { return i.get() < n; },
+                    [&] {
+                      total.set(total.get() + i.get());
+                      i.set(i.get() + 1_u32);
+                    });
+    codegen::return_(total.get());
+  });
+
+  auto module = std::move(builder).build();
+  auto sum_ptr = module.get_address(sum);
+  EXPECT_EQ(sum_ptr(0), 0);
+  EXPECT_EQ(sum_ptr(1), 0);
+  EXPECT_EQ(sum_ptr(10), 45);
+  EXPECT_EQ(sum_ptr(1000), 499500);
+}
+
+TEST(module_builder, no_debug_codegen) {
+  auto comp = codegen::compiler_context("codegen", codegen::compiler_options{.debug_info = false});
+  auto builder = codegen::module_builder(comp, "no_debug_codegen", false);
+
+  auto source_file = std::filesystem::temp_directory_path() / ("cg_" + comp.name()) / "no_debug_codegen.c";
+  std::filesystem::remove(source_file);
+
+  auto twice = builder.create_function<int32_t(int32_t)>(
+      "twice", [](codegen::value<int32_t> x) { codegen::return_(x + x); });
+  auto sum = builder.create_function<int32_t(int32_t*, int32_t)>(
+      "sum", [&](codegen::value<int32_t*> ptr, codegen::value<int32_t> n) {
+        auto total = codegen::variable<int32_t>("total", 0_i32);
+        auto idx = codegen::variable<int32_t>("idx", 0_i32);
+        codegen::while_([&] { return idx.get() < n; },
+                        [&] {
+                          auto v = codegen::load(ptr + idx.get());
+                          codegen::if_(v > 0_i32, [&] { total.set(total.get() + codegen::call(twice, v)); },
+                                       [&] { total.set(total.get() + v); });
+                          idx.set(idx.get() + 1_i32);
+                        });
+        codegen::return_(total.get());
+      });
+
+  auto module = std::move(builder).build();
+  EXPECT_FALSE(std::filesystem::exists(source_file));
+
+  auto values = std::vector<int32_t>{1, -2, 3, -4};
+  EXPECT_EQ(module.get_address(sum)(values.data(), int32_t(values.size())), 2);
+}
+
+TEST(module_builder, compile_report) {
+  auto comp = codegen::compiler_context("codegen", codegen::optimization_level::O2);
+  auto builder = codegen::module_builder(comp, "compile_report");
+
+  auto add = builder.create_function<int32_t(int32_t, int32_t)>(
+      "add", [](codegen::value<int32_t> a, codegen::value<int32_t> b) { codegen::return_(a + b); });
+  auto max = builder.create_function<int32_t(int32_t, int32_t)>(
+      "max", [](codegen::value<int32_t> a, codegen::value<int32_t> b) {
+        codegen::if_(a > b, [&] { codegen::return_(a); }, [&] { codegen::return_(b); });
+      });
+
+  auto module = std::move(builder).build();
+  EXPECT_EQ(module.get_address(add)(2, 3), 5);
+  EXPECT_EQ(module.get_address(max)(2, 3), 3);
+
+  auto report = module.report();
+  ASSERT_EQ(report.functions.size(), 2);
+  EXPECT_EQ(report.functions[0].name, "add");
+  EXPECT_EQ(report.functions[0].basic_blocks, 1);
+  EXPECT_EQ(report.functions[1].name, "max");
+  EXPECT_GT(report.functions[1].basic_blocks, 1);
+  EXPECT_GT(report.functions[1].instructions, report.functions[0].instructions);
+  EXPECT_GT(report.ir_generation.count(), 0);
+  EXPECT_GT(report.optimization.count(), 0);
+  EXPECT_GT(report.code_generation.count(), 0);
+  EXPECT_GT(report.linking.count(), 0);
+  EXPECT_GT(report.object_size, 0);
+  EXPECT_EQ(report.symbol_lookups, 2);
+
+  auto counters = comp.statistics();
+  EXPECT_EQ(counters.modules, 1);
+  EXPECT_EQ(counters.functions, 2);
+  EXPECT_EQ(counters.object_size, report.object_size);
+  EXPECT_EQ(counters.code_generation, report.code_generation);
+  EXPECT_EQ(counters.symbol_lookups, 2);
+}
+
+TEST(module_builder, perf_map) {
+  auto comp = codegen::compiler_context("codegen", codegen::compiler_options{.perf_map = true});
+  auto builder = codegen::module_builder(comp, "perf_map");
+  auto add = builder.create_function<int32_t(int32_t, int32_t)>(
+      "perf_map_add", [](codegen::value<int32_t> a, codegen::value<int32_t> b) { codegen::return_(a + b); });
+  auto module = std::move(builder).build();
+  auto add_ptr = module.get_address(add);
+  EXPECT_EQ(add_ptr(2, 3), 5);
+
+  auto ifs = std::ifstream(fmt::format("/tmp/perf-{}.map", getpid()));
+  auto line = std::string{};
+  auto found = false;
+  while (std::getline(ifs, line)) {
+    if (line.ends_with(" perf_map_add")) {
+      EXPECT_EQ(std::stoull(line.substr(0, line.find(' ')), nullptr, 16), reinterpret_cast<uintptr_t>(add_ptr));
+      found = true;
+    }
+  }
+  EXPECT_TRUE(found);
+}
+
+TEST(module_builder, arena_memory) {
+  if (!codegen::detail::arena_allocator::supported) {
+    EXPECT_THROW(codegen::compiler_context("codegen", codegen::compiler_options{.arena_memory = true}),
+                 codegen::llvm_error);
+    return;
+  }
+
+  auto comp = codegen::compiler_context("codegen", codegen::compiler_options{.arena_memory = true});
+  EXPECT_EQ(comp.code_memory().mapped, 0);
+
+  {
+    auto builder = codegen::module_builder(comp, "arena_memory");
+    auto add = builder.create_function<int32_t(int32_t, int32_t)>(
+        "add", [](codegen::value<int32_t> a, codegen::value<int32_t> b) { codegen::return_(a + b); });
+    auto module = std::move(builder).build();
+    EXPECT_EQ(module.get_address(add)(2, 3), 5);
+
+    EXPECT_GT(module.report().loaded_size, 0);
+    EXPECT_GT(comp.code_memory().allocated, 0);
+    EXPECT_GE(comp.code_memory().mapped, comp.code_memory().allocated);
+  }
+
+  EXPECT_EQ(comp.code_memory().allocated, 0);
+  EXPECT_EQ(comp.code_memory().mapped, 0);
+}
+
+namespace {
+// the generated headers have to be accepted by the compiler the library is built with.
+bool compiles_header(std::filesystem::path const& path) {
+  auto command = fmt::format("{} -std=c++17 -fsyntax-only -x c++ {}", CODEGEN_TEST_CXX_COMPILER, path.string());
+  return std::system(command.c_str()) == 0;
+}
+} // namespace
+
+TEST(module_builder, emit_object) {
+  auto directory = std::filesystem::temp_directory_path() / "cg_emit_object_test";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+
+  auto comp = codegen::compiler_context{};
+  auto generate = [&](codegen::module_builder& builder) {
+    builder.create_function<int32_t(int32_t, int32_t)>(
+        "aot_add", [](codegen::value<int32_t> a, codegen::value<int32_t> b) { codegen::return_(a + b); });
+    builder.create_function<void(float*, uint64_t const*)>(
+        "aot_store", [](codegen::value<float*>, codegen::value<uint64_t const*>) { codegen::return_(); });
+  };
+
+  {
+    auto builder = codegen::module_builder(comp, "emit_object");
+    generate(builder);
+    std::move(builder).emit_object(directory / "kernels.o", {.header = directory / "kernels.hpp"});
+  }
+  EXPECT_GT(std::filesystem::file_size(directory / "kernels.o"), 0);
+
+  auto ifs = std::ifstream(directory / "kernels.hpp");
+  auto header = std::string(std::istreambuf_iterator<char>(ifs), {});
+  EXPECT_NE(header.find("int32_t aot_add(int32_t arg0, int32_t arg1);"), std::string::npos);
+  EXPECT_NE(header.find("void aot_store(float* arg0, uint64_t const* arg1);"), std::string::npos);
+  EXPECT_TRUE(compiles_header(directory / "kernels.hpp"));
+
+  {
+    auto builder = codegen::module_builder(comp, "emit_archive");
+    generate(builder);
+    std::move(builder).emit_archive(directory / "libkernels.a", {.level = codegen::optimization_level::O3});
+  }
+  auto archive = std::ifstream(directory / "libkernels.a", std::ios::binary);
+  auto magic = std::string(8, '\0');
+  archive.read(magic.data(), magic.size());
+  EXPECT_EQ(magic, "!<arch>\n");
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST(module_builder, emit_object_baseline_cpu) {
+  auto comp = codegen::compiler_context{};
+
+  auto context = llvm::LLVMContext{};
+  auto module = llvm::Module("baseline_cpu", context);
+  auto fn = llvm::Function::Create(llvm::FunctionType::get(llvm::Type::getVoidTy(context), false),
+                                   llvm::GlobalValue::ExternalLinkage, "baseline_fn", module);
+  llvm::ReturnInst::Create(context, llvm::BasicBlock::Create(context, "entry", fn));
+  fn->addFnAttr("target-features", comp.target_features());
+
+  auto options = codegen::aot_options{};
+  options.cpu = "generic";
+  auto object = codegen::detail::compile_object(module, options, codegen::optimization_level::O1);
+  EXPECT_GT(object.size(), 0);
+  EXPECT_EQ(fn->getFnAttribute("target-cpu").getValueAsString(), "generic");
+  EXPECT_FALSE(fn->hasFnAttribute("target-features"));
+}
+
+TEST(module_builder, signatures) {
+  using array_fn = codegen::detail::function_builder<int32_t(int32_t (*)[4], uint64_t)>;
+  auto signature = array_fn::signature("sum");
+  EXPECT_EQ(signature.return_type, "int32_t");
+  EXPECT_EQ(signature.arguments, (std::vector<std::string>{"int32_t (*arg0)[4]", "uint64_t arg1"}));
+  EXPECT_EQ(codegen::detail::type<float const**>::cxx_name("arg0"), "float const** arg0");
+  EXPECT_EQ(codegen::detail::type<int32_t (*)[4]>::cxx_name(), "int32_t (*)[4]");
+
+  auto directory = std::filesystem::temp_directory_path() / "cg_signatures_test";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  using scale_fn = codegen::detail::function_builder<void(float const**, codegen::vec<float, 8>*, std::byte)>;
+  codegen::detail::write_header(directory / "signatures.hpp", "signatures", {signature, scale_fn::signature("scale")});
+  EXPECT_TRUE(compiles_header(directory / "signatures.hpp"));
+  std::filesystem::remove_all(directory);
+}
+
+TEST(module_builder, struct_signatures) {
+  using pair = codegen::Struct<int32_t, float*>;
+  using pointers_fn = codegen::detail::function_builder<void(pair*, codegen::Struct<int32_t>*)>;
+  auto pointers = pointers_fn::signature("pointers");
+  EXPECT_TRUE(pointers.declarable);
+  EXPECT_EQ(pointers.arguments,
+            (std::vector<std::string>{"struct codegen_struct_i32_f32p* arg0", "struct codegen_struct_i32* arg1"}));
+
+  // structs are opaque in headers, they cannot be passed by value.
+  auto by_value = codegen::detail::function_builder<void(pair)>::signature("by_value");
+  EXPECT_FALSE(by_value.declarable);
+  auto path = std::filesystem::temp_directory_path() / "cg_struct_signatures_test.hpp";
+  EXPECT_THROW(codegen::detail::write_header(path, "struct_signatures", {pointers, by_value}), codegen::llvm_error);
+  EXPECT_FALSE(std::filesystem::exists(path));
+}
+
+TEST(module_builder, bitcode) {
+  auto path = std::filesystem::temp_directory_path() / "cg_bitcode_test.bc";
+
+  auto comp = codegen::compiler_context{};
+  {
+    auto builder = codegen::module_builder(comp, "bitcode");
+    auto add = builder.create_function<int32_t(int32_t, int32_t)>(
+        "add", [](codegen::value<int32_t> a, codegen::value<int32_t> b) { codegen::return_(a + b); });
+    builder.create_function<int32_t(int32_t)>(
+        "add_one", [&](codegen::value<int32_t> x) { codegen::return_(codegen::call(add, x, 1_i32)); });
+    builder.set_optimization_level(codegen::optimization_level::O2);
+    std::move(builder).save_bitcode(path);
+  }
+
+  auto module = codegen::load_bitcode(comp, path);
+  EXPECT_EQ(module.get_address<int32_t(int32_t, int32_t)>("add")(2, 3), 5);
+  EXPECT_EQ(module.get_address<int32_t(int32_t)>("add_one")(41), 42);
+  EXPECT_THROW(module.get_address<int64_t(int64_t)>("add_one"), codegen::llvm_error);
+  EXPECT_THROW(module.get_address<int32_t(int32_t)>("sub"), codegen::llvm_error);
+  EXPECT_EQ(module.report().functions.size(), 2);
+
+  std::filesystem::remove(path);
+}
+
+TEST(module_builder, target) {
+  auto host_features = llvm::StringMap<bool>{};
+  llvm::sys::getHostCPUFeatures(host_features);
+
+  struct level {
+    std::string cpu;
+    std::string features;
+    std::string required;
+  };
+  auto levels = std::vector<level>{
+      {"x86-64", "", "sse2"},
+      {"x86-64", "+avx2,+fma", "avx2"},
+      {"haswell", "", "avx2"},
+      {"skylake-avx512", "", "avx512f"},
+  };
+
+  for (auto& l : levels) {
+    if (!host_features.lookup(l.required)) { continue; }
+    auto target = codegen::target_description{.cpu = l.cpu};
+    if (!l.features.empty()) { target.features = l.features; }
+    auto comp = codegen::compiler_context(
+        "codegen", codegen::compiler_options{.level = codegen::optimization_level::O3, .target = target});
+    EXPECT_EQ(comp.target_cpu(), l.cpu);
+
+    auto builder = codegen::module_builder(comp, "target");
+    auto sum = builder.create_function<int32_t(int32_t*, int32_t)>(
+        "sum", [&](codegen::value<int32_t*> ptr, codegen::value<int32_t> n) {
+          auto total = codegen::variable<int32_t>("total", 0_i32);
+          auto idx = codegen::variable<int32_t>("idx", 0_i32);
+          codegen::while_([&] { return idx.get() < n; },
+                          [&] {
+                            total.set(total.get() + codegen::load(ptr + idx.get()));
+                            idx.set(idx.get() + 1_i32);
+                          });
+          codegen::return_(total.get());
+        });
+    EXPECT_EQ(builder.module().getFunction("sum")->getFnAttribute("target-cpu").getValueAsString(), l.cpu);
+
+    auto module = std::move(builder).build();
+    auto values = std::vector<int32_t>(1000);
+    std::iota(values.begin(), values.end(), 0);
+    EXPECT_EQ(module.get_address(sum)(values.data(), int32_t(values.size())), 499500);
+  }
+}
+
+TEST(module_builder, get_addresses) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "get_addresses");
+
+  auto add = builder.create_function<int32_t(int32_t, int32_t)>(
+      "add", [](codegen::value<int32_t> a, codegen::value<int32_t> b) { codegen::return_(a + b); });
+  auto neg = builder.create_function<int64_t(int64_t)>(
+      "neg", [](codegen::value<int64_t> a) { codegen::return_(0_i64 - a); });
+  auto set_true = builder.create_function<void(bool*)>("set_true", [](codegen::value<bool*> ptr) {
+    codegen::store(codegen::true_(), ptr);
+    codegen::return_();
+  });
+
+  auto module = std::move(builder).build();
+  auto [add_ptr, neg_ptr, set_true_ptr] = module.get_addresses(add, neg, set_true);
+  EXPECT_EQ(module.report().symbol_lookups, 1);
+
+  EXPECT_EQ(add_ptr(2, 3), 5);
+  EXPECT_EQ(neg_ptr(7), -7);
+  bool flag = false;
+  set_true_ptr(&flag);
+  EXPECT_TRUE(flag);
+}
+
+TEST(module_builder, explicit_symbols) {
+  auto comp = codegen::compiler_context("codegen", codegen::compiler_options{.process_symbols = false});
+
+  {
+    auto builder = codegen::module_builder(comp, "explicit_symbols");
+    auto callee =
+        builder.declare_external_function<void(bool*)>("set_true", [](bool* flag) { *flag = true; });
+    auto caller = builder.create_function<int32_t(bool*, char*, char*)>(
+        "caller", [&](codegen::value<bool*> f, codegen::value<char*> a, codegen::value<char*> b) {
+          codegen::call(callee, f);
+          codegen::return_(codegen::builtin::memcmp(a, b, 4_u64));
+        });
+
+    auto module = std::move(builder).build();
+    bool called = false;
+    char a[] = "abcd";
+    char b[] = "abcd";
+    EXPECT_EQ(module.get_address(caller)(&called, a, b), 0);
+    EXPECT_TRUE(called);
+  }
+
+  {
+    // floating point remainder is a call to fmod, which the generated code links against without process symbols.
+    auto builder = codegen::module_builder(comp, "libcalls");
+    auto rem = builder.create_function<double(double, double)>(
+        "rem", [](codegen::value<double> a, codegen::value<double> b) { codegen::return_(a % b); });
+    auto remf = builder.create_function<float(float, float)>(
+        "remf", [](codegen::value<float> a, codegen::value<float> b) { codegen::return_(a % b); });
+
+    auto module = std::move(builder).build();
+    EXPECT_EQ(module.get_address(rem)(7.5, 2), 1.5);
+    EXPECT_EQ(module.get_address(remf)(-7.5f, 2), -1.5f);
+  }
+
+  {
+    // getpid() is neither declared with declare_external_function() nor added with add_symbol().
+    auto builder = codegen::module_builder(comp, "undeclared_symbol");
+    auto getpid_fn = llvm::Function::Create(llvm::FunctionType::get(builder.ir_builder().getInt32Ty(), false),
+                                            llvm::GlobalValue::ExternalLinkage, "getpid", builder.module());
+    auto caller = builder.create_function<int32_t()>("caller", [&] {
+      codegen::return_(codegen::value<int32_t>{builder.ir_builder().CreateCall(getpid_fn), "pid"});
+    });
+
+    auto module = std::move(builder).build();
+    EXPECT_THROW(module.get_address(caller), codegen::llvm_error);
+  }
+}
+
+TEST(module_builder, runtime_library) {
+  auto path = std::filesystem::temp_directory_path() / fmt::format("codegen-runtime-{}.bc", getpid());
+  {
+    auto comp = codegen::compiler_context{};
+    auto builder = codegen::module_builder(comp, "runtime", false);
+    builder.create_function<int32_t(int32_t)>("triple", [](codegen::value<int32_t> x) { codegen::return_(x * 3_i32); });
+    std::move(builder).save_bitcode(path);
+  }
+  auto ifs = std::ifstream(path, std::ios::binary);
+  auto bitcode = std::string(std::istreambuf_iterator<char>(ifs), {});
+
+  for (auto embedded : {false, true}) {
+    auto comp = codegen::compiler_context("codegen", codegen::optimization_level::O3);
+    if (embedded) {
+      comp.add_runtime_library_bitcode(llvm::MemoryBufferRef(bitcode, "runtime"));
+    } else {
+      comp.add_runtime_library(path);
+    }
+
+    auto builder = codegen::module_builder(comp, "runtime_library");
+    auto triple = builder.declare_runtime_function<int32_t(int32_t)>("triple");
+    auto caller = builder.create_function<int32_t(int32_t)>(
+        "caller", [&](codegen::value<int32_t> x) { codegen::return_(codegen::call(triple, x) + 1_i32); });
+
+    auto module = std::move(builder).build();
+    EXPECT_EQ(module.get_address(caller)(4), 13);
+    auto functions = module.report().functions;
+    EXPECT_TRUE(std::any_of(functions.begin(), functions.end(), [](auto& fn) { return fn.name == "triple"; }));
+    // runtime functions are linked with internal linkage.
+    EXPECT_THROW(module.get_address(triple), codegen::llvm_error);
+  }
+
+  auto comp = codegen::compiler_context{};
+  EXPECT_THROW(comp.add_runtime_library_bitcode(llvm::MemoryBufferRef("not bitcode", "runtime")), codegen::llvm_error);
+
+  std::filesystem::remove(path);
+}
+
+namespace {
+int32_t shared_add_one(int32_t x) {
+  return x + 1;
+}
+int32_t shared_add_two(int32_t x) {
+  return x + 2;
+}
+} // namespace
+
+TEST(module_builder, shared_code_cache) {
+  auto path = std::filesystem::temp_directory_path() / fmt::format("codegen-shared-{}.cache", getpid());
+  std::filesystem::remove(path);
+
+  auto build = [](codegen::compiler_context& comp, int32_t (*external)(int32_t)) {
+    auto builder = codegen::module_builder(comp, "shared_code_cache");
+    auto ext = builder.declare_external_function("shared_external", external);
+    auto fn = builder.create_function<int32_t(int32_t)>(
+        "fn", [&](codegen::value<int32_t> x) { codegen::return_(codegen::call(ext, x) * 2_i32); });
+    auto module = std::move(builder).build();
+    return module.get_address(fn)(20);
+  };
+
+  auto producer = codegen::compiler_context{};
+  producer.enable_shared_code_cache(path, 16 << 20);
+  ASSERT_TRUE(producer.get_shared_code_cache().enabled());
+  EXPECT_EQ(build(producer, &shared_add_one), 42);
+  EXPECT_EQ(producer.get_shared_code_cache().inserts(), 1);
+  EXPECT_GT(producer.get_shared_code_cache().used(), 0);
+
+  // contexts in the same process share the mapping of the file.
+  auto consumer = codegen::compiler_context{};
+  consumer.enable_shared_code_cache(path);
+  ASSERT_TRUE(consumer.get_shared_code_cache().enabled());
+  EXPECT_EQ(build(consumer, &shared_add_one), 42);
+  EXPECT_EQ(consumer.get_shared_code_cache().hits(), 1);
+  EXPECT_EQ(consumer.get_shared_code_cache().inserts(), 0);
+
+  // the cached code calls a different function than the one this module links against.
+  EXPECT_EQ(build(consumer, &shared_add_two), 44);
+  EXPECT_EQ(consumer.get_shared_code_cache().rejected(), 1);
+  EXPECT_EQ(consumer.get_shared_code_cache().inserts(), 1);
+  EXPECT_EQ(build(producer, &shared_add_two), 44);
+  EXPECT_EQ(producer.get_shared_code_cache().hits(), 1);
+
+  std::filesystem::remove(path);
+}
+
+TEST(module_builder, shared_code_cache_report) {
+  auto path = std::filesystem::temp_directory_path() / fmt::format("codegen-shared-report-{}.cache", getpid());
+  std::filesystem::remove(path);
+
+  auto comp = codegen::compiler_context("codegen", codegen::compiler_options{.level = codegen::optimization_level::O2});
+  comp.enable_shared_code_cache(path, 16 << 20);
+  ASSERT_TRUE(comp.get_shared_code_cache().enabled());
+
+  auto builder = codegen::module_builder(comp, "shared_code_cache_report");
+  auto add = builder.create_function<int32_t(int32_t, int32_t)>(
+      "add", [](codegen::value<int32_t> a, codegen::value<int32_t> b) { codegen::return_(a + b); });
+  auto module = std::move(builder).build();
+  EXPECT_EQ(module.get_address(add)(2, 3), 5);
+  EXPECT_EQ(comp.get_shared_code_cache().inserts(), 1);
+
+  auto report = module.report();
+  EXPECT_GT(report.optimization.count(), 0);
+  EXPECT_GT(report.code_generation.count(), 0);
+  EXPECT_GT(report.linking.count(), 0);
+  EXPECT_GT(report.object_size, 0);
+
+  auto counters = comp.statistics();
+  EXPECT_EQ(counters.optimization, report.optimization);
+  EXPECT_EQ(counters.code_generation, report.code_generation);
+  EXPECT_EQ(counters.object_size, report.object_size);
+
+  std::filesystem::remove(path);
+}
+
+TEST(module_builder, shared_code_cache_fork) {
+  auto path = std::filesystem::temp_directory_path() / fmt::format("codegen-shared-fork-{}.cache", getpid());
+  std::filesystem::remove(path);
+
+  auto build = [](codegen::compiler_context& comp) {
+    auto builder = codegen::module_builder(comp, "shared_code_cache_fork");
+    auto ext = builder.declare_external_function("shared_external", &shared_add_one);
+    auto fn = builder.create_function<int32_t(int32_t)>(
+        "fn", [&](codegen::value<int32_t> x) { codegen::return_(codegen::call(ext, x) * 2_i32); });
+    auto module = std::move(builder).build();
+    return module.get_address(fn)(20);
+  };
+
+  // the consumer maps the file only after the producer has written it, at the address chosen by the producer.
+  auto consumer = codegen::compiler_context{};
+
+  auto pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    auto producer = codegen::compiler_context{};
+    producer.enable_shared_code_cache(path, 16 << 20);
+    auto& cache = producer.get_shared_code_cache();
+    auto ok = cache.enabled() && build(producer) == 42 && cache.inserts() == 1;
+    _exit(ok ? 0 : 1);
+  }
+  auto status = 0;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  ASSERT_EQ(WEXITSTATUS(status), 0);
+
+  consumer.enable_shared_code_cache(path);
+  ASSERT_TRUE(consumer.get_shared_code_cache().enabled());
+  EXPECT_EQ(build(consumer), 42);
+  EXPECT_EQ(consumer.get_shared_code_cache().hits(), 1);
+  EXPECT_EQ(consumer.get_shared_code_cache().inserts(), 0);
+
+  std::filesystem::remove(path);
+}
+
+TEST(module_builder, multiple_modules) {
+  auto comp = codegen::compiler_context{};
+
+  using get_fn = codegen::function_ref<int32_t>;
+  auto build = [&](int32_t constant, std::optional<get_fn>& get) {
+    auto builder = codegen::module_builder(comp, "multiple_modules");
+    get = builder.create_function<int32_t()>("get", [&] { codegen::return_(codegen::constant<int32_t>(constant)); });
+    return std::move(builder).build();
+  };
+
+  auto second_get = std::optional<get_fn>{};
+  auto second = std::optional<codegen::module>{};
+  {
+    auto first_get = std::optional<get_fn>{};
+    auto first = build(1, first_get);
+    second.emplace(build(2, second_get));
+    EXPECT_EQ(first.get_address(*first_get)(), 1);
+    EXPECT_EQ(second->get_address(*second_get)(), 2);
+  }
+  EXPECT_EQ(second->get_address(*second_get)(), 2);
+
+  for (auto i = 0; i < 100; i++) {
+    auto get = std::optional<get_fn>{};
+    auto module = build(i, get);
+    EXPECT_EQ(module.get_address(*get)(), i);
+  }
+  EXPECT_EQ(second->get_address(*second_get)(), 2);
+}
+
+TEST(module_builder, object_cache) {
+  auto directory = std::filesystem::temp_directory_path() / "cg_object_cache_test";
+  std::filesystem::remove_all(directory);
+
+  auto build_and_run = [&] {
+    auto comp = codegen::compiler_context("codegen", codegen::optimization_level::O2);
+    comp.enable_object_cache(directory);
+
+    auto builder = codegen::module_builder(comp, "object_cache");
+    auto add = builder.create_function<int32_t(int32_t, int32_t)>(
+        "add", [](codegen::value<int32_t> a, codegen::value<int32_t> b) { codegen::return_(a + b); });
+    auto module = std::move(builder).build();
+    auto add_ptr = module.get_address(add);
+    EXPECT_EQ(add_ptr(2, 3), 5);
+    EXPECT_EQ(add_ptr(-2, 1), -1);
+  };
+
+  auto count_objects = [&] {
+    auto it = std::filesystem::directory_iterator(directory);
+    return std::distance(std::filesystem::begin(it), std::filesystem::end(it));
+  };
+
+  build_and_run();
+  EXPECT_EQ(count_objects(), 1);
+  auto object = *std::filesystem::directory_iterator(directory);
+  auto write_time = object.last_write_time();
+
+  build_and_run();
+  EXPECT_EQ(count_objects(), 1);
+  EXPECT_EQ(std::filesystem::last_write_time(object.path()), write_time);
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST(module_builder, module_cache) {
+  auto comp = codegen::compiler_context("codegen", codegen::optimization_level::O2);
+  comp.enable_module_cache(4);
+
+  auto build = [&](std::string const& name) {
+    auto builder = codegen::module_builder(comp, name);
+    auto add = builder.create_function<int32_t(int32_t, int32_t)>(
+        name + "_add", [](codegen::value<int32_t> a, codegen::value<int32_t> b) { codegen::return_(a + b); });
+    auto mul = builder.create_function<int32_t(int32_t, int32_t)>(
+        name + "_mul", [](codegen::value<int32_t> a, codegen::value<int32_t> b) { codegen::return_(a * b); });
+    auto module = std::move(builder).build();
+    EXPECT_EQ(module.get_address(add)(2, 3), 5);
+    EXPECT_EQ(module.get_address(mul)(2, 3), 6);
+  };
+
+  build("first");
+  EXPECT_EQ(comp.get_module_cache().hits(), 0);
+  EXPECT_EQ(comp.get_module_cache().misses(), 1);
+  EXPECT_EQ(comp.get_module_cache().size(), 1);
+
+  build("second");
+  EXPECT_EQ(comp.get_module_cache().hits(), 1);
+  EXPECT_EQ(comp.get_module_cache().misses(), 1);
+  EXPECT_EQ(comp.get_module_cache().size(), 1);
+}
+
+TEST(module_builder, module_cache_external_functions) {
+  auto comp = codegen::compiler_context{};
+  comp.enable_module_cache(4);
+
+  auto build = [&](int32_t (*external)(int32_t)) {
+    auto builder = codegen::module_builder(comp, "module_cache_external_functions");
+    auto ext = builder.declare_external_function("ext", external);
+    auto fn = builder.create_function<int32_t(int32_t)>(
+        "fn", [&](codegen::value<int32_t> x) { codegen::return_(codegen::call(ext, x)); });
+    auto module = std::move(builder).build();
+    return module.get_address(fn)(40);
+  };
+
+  // the modules have the same IR, but call different host functions.
+  EXPECT_EQ(build([](int32_t x) { return x + 1; }), 41);
+  EXPECT_EQ(build([](int32_t x) { return x + 2; }), 42);
+  EXPECT_EQ(comp.get_module_cache().hits(), 0);
+  EXPECT_EQ(comp.get_module_cache().misses(), 2);
+  EXPECT_EQ(comp.get_module_cache().size(), 2);
+}
+
+TEST(module_builder, module_cache_eviction) {
+  auto cache = codegen::module_cache{};
+  cache.set_capacity(2);
+
+  cache.insert("a", {nullptr, {"a"}});
+  cache.insert("b", {nullptr, {"b"}});
+  EXPECT_TRUE(cache.find("a"));
+  cache.insert("c", {nullptr, {"c"}});
+
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_TRUE(cache.find("a"));
+  EXPECT_FALSE(cache.find("b"));
+  EXPECT_TRUE(cache.find("c"));
+  EXPECT_EQ(cache.hits(), 3);
+  EXPECT_EQ(cache.misses(), 1);
+
+  cache.set_capacity(1);
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_TRUE(cache.find("c"));
+}
+
+TEST(module_builder, build_async) {
+  auto comp = codegen::compiler_context("codegen", codegen::compiler_options{.level = codegen::optimization_level::O2,
+                                                                            .compile_threads = 4});
+
+  constexpr auto thread_count = 4;
+  constexpr auto modules_per_thread = 64;
+
+  auto threads = std::vector<std::thread>{};
+  for (auto t = 0; t < thread_count; t++) {
+    threads.emplace_back([&, t] {
+      using fn_type = codegen::function_ref<int32_t, int32_t>;
+      auto pending = std::vector<std::pair<std::future<codegen::module>, fn_type>>{};
+      for (auto i = 0; i < modules_per_thread; i++) {
+        auto id = t * modules_per_thread + i;
+        auto builder = codegen::module_builder(comp, "build_async_" + std::to_string(id));
+        auto fn = builder.create_function<int32_t(int32_t)>("fn", [&](codegen::value<int32_t> x) {
+          auto total = codegen::variable<int32_t>("total", x);
+          codegen::if_(x > 0_i32, [&] { total.set(total.get() * codegen::constant<int32_t>(id)); });
+          codegen::return_(total.get());
+        });
+        pending.emplace_back(std::move(builder).build_async(), fn);
+      }
+      for (auto i = 0; i < modules_per_thread; i++) {
+        auto id = t * modules_per_thread + i;
+        auto module = pending[i].first.get();
+        auto fn_ptr = module.get_address(pending[i].second);
+        EXPECT_EQ(fn_ptr(2), 2 * id);
+        EXPECT_EQ(fn_ptr(-3), -3);
+      }
+    });
+  }
+  for (auto& thread : threads) { thread.join(); }
+}
+
+TEST(module_builder, lazy) {
+  auto comp = codegen::compiler_context("codegen", codegen::compiler_options{.lazy = true});
+  EXPECT_TRUE(comp.is_lazy());
+
+  auto build_and_run = [&](int32_t offset) {
+    auto builder = codegen::module_builder(comp, "lazy");
+
+    using fn_type = codegen::function_ref<int32_t, int32_t>;
+    auto functions = std::vector<fn_type>{};
+    for (auto i = 0; i < 100; i++) {
+      functions.emplace_back(builder.create_function<int32_t(int32_t)>(
+          "mul" + std::to_string(i),
+          [&](codegen::value<int32_t> x) {
+            codegen::return_(x * codegen::constant<int32_t>(i) + codegen::constant<int32_t>(offset));
+          }));
+    }
+    auto caller = builder.create_function<int32_t(int32_t)>(
+        "caller", [&](codegen::value<int32_t> x) { codegen::return_(codegen::call(functions[42], x) + 1_i32); });
+
+    auto module = std::move(builder).build();
+    // nothing is compiled until the first call.
+    EXPECT_EQ(module.report().object_size, 0u);
+
+    EXPECT_EQ(module.get_address(functions[7])(3), 21 + offset);
+    auto one_function = module.report().object_size;
+    EXPECT_GT(one_function, 0u);
+
+    EXPECT_EQ(module.get_address(caller)(2), 85 + offset);
+    EXPECT_EQ(module.get_address(functions[42])(-1), -42 + offset);
+    auto three_functions = module.report().object_size;
+    EXPECT_GT(three_functions, one_function);
+    // the 97 functions that were never called are not compiled.
+    EXPECT_LT(three_functions, 10 * one_function);
+  };
+
+  // modules defining the same names are built after the previous ones are destroyed.
+  build_and_run(0);
+  build_and_run(1000);
+  build_and_run(2000);
+}
+
+TEST(module_builder, tiered) {
+  auto comp = codegen::compiler_context("codegen", codegen::compiler_options{.tier_up_threshold = 16});
+  EXPECT_TRUE(comp.is_tiered());
+
+  auto builder = codegen::module_builder(comp, "tiered");
+  auto sum = builder.create_function<uint32_t(uint32_t)>("sum", [](codegen::value<uint32_t> n) {
+    auto i = codegen::variable<uint32_t>("i", 0_u32);
+    auto total = codegen::variable<uint32_t>("total", 0_u32);
+    codegen::while_([&] { return i.get() < n; },
+                    [&] {
+                      total.set(total.get() + i.get());
+                      i.set(i.get() + 1_u32);
+                    });
+    codegen::return_(total.get());
+  });
+  auto twice_sum = builder.create_function<uint32_t(uint32_t)>(
+      "twice_sum", [&](codegen::value<uint32_t> n) { codegen::return_(codegen::call(sum, n) * 2_u32); });
+
+  auto module = std::move(builder).build();
+  auto sum_ptr = module.get_address(sum);
+  auto twice_sum_ptr = module.get_address(twice_sum);
+
+  for (auto i = 0; i < 15; i++) { EXPECT_EQ(sum_ptr(10), 45); }
+  EXPECT_EQ(comp.tier_ups(), 0);
+
+  // the 16th call, through twice_sum, makes sum hot.
+  EXPECT_EQ(twice_sum_ptr(10), 90);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+  while (comp.tier_ups() == 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(comp.tier_ups(), 1);
+
+  EXPECT_EQ(module.get_address(sum), sum_ptr);
+  EXPECT_EQ(sum_ptr(10), 45);
+  EXPECT_EQ(sum_ptr(1000), 499500);
+  EXPECT_EQ(twice_sum_ptr(1000), 999000);
+}
+
+TEST(module_builder, tiered_local_symbols) {
+  auto comp = codegen::compiler_context("codegen", codegen::compiler_options{.tier_up_threshold = 4});
+
+  auto builder = codegen::module_builder(comp, "tiered_local_symbols");
+  auto& irb = builder.ir_builder();
+  auto table_type = llvm::ArrayType::get(irb.getInt32Ty(), 4);
+  auto table = new llvm::GlobalVariable(builder.module(), table_type, true, llvm::GlobalValue::PrivateLinkage,
+                                        llvm::ConstantDataArray::get(builder.context(),
+                                                                     llvm::ArrayRef<uint32_t>{3, 5, 7, 11}),
+                                        "table");
+
+  auto twice = builder.create_function<uint32_t(uint32_t)>(
+      "twice", [](codegen::value<uint32_t> x) { codegen::return_(x * 2_u32); });
+  static_cast<llvm::Function*>(twice)->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+  auto lookup = builder.create_function<uint32_t(uint32_t)>("lookup", [&](codegen::value<uint32_t> i) {
+    auto entry = irb.CreateInBoundsGEP(table_type, table, {irb.getInt64(0), codegen::cast<uint64_t>(i).eval()});
+    codegen::return_(codegen::call(twice, codegen::value<uint32_t>{irb.CreateLoad(irb.getInt32Ty(), entry), "entry"}));
+  });
+
+  auto module = std::move(builder).build();
+  auto lookup_ptr = module.get_address(lookup);
+  auto expected = std::array<uint32_t, 4>{6, 10, 14, 22};
+  for (auto i = 0u; i < 8; i++) { EXPECT_EQ(lookup_ptr(i % 4), expected[i % 4]); }
+
+  // both lookup and the internal twice become hot, their optimized code refers to the table and to twice.
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+  while (comp.tier_ups() < 2 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(comp.tier_ups(), 2);
+  EXPECT_EQ(lookup_ptr(3), 22u);
+}
+
+TEST(module_builder, tiered_stub_reuse) {
+  auto comp = codegen::compiler_context("codegen", codegen::compiler_options{.tier_up_threshold = 16});
+
+  auto build_and_run = [&](int32_t constant) {
+    auto builder = codegen::module_builder(comp, "tiered_stub_reuse");
+    auto fn = builder.create_function<int32_t(int32_t)>(
+        "fn", [&](codegen::value<int32_t> x) { codegen::return_(x + codegen::constant<int32_t>(constant)); });
+    auto module = std::move(builder).build();
+    auto fn_ptr = module.get_address(fn);
+    EXPECT_EQ(fn_ptr(1), 1 + constant);
+    return reinterpret_cast<uintptr_t>(fn_ptr);
+  };
+
+  // the stub of the destroyed module is reused by the next one.
+  auto first = build_and_run(1);
+  for (auto i = 2; i < 10; i++) { EXPECT_EQ(build_and_run(i), first); }
+}
+
 int main(int argc, char** argv) {
   INIT_LLVM_ENV(argc, argv);
   ::testing::InitGoogleTest(&argc, argv);
@@ -20,6 +20,11 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "codegen/codegen.hpp"
 
 #include <gtest/gtest.h>
@@ -226,6 +231,260 @@ TEST(statements, while_loop_break) {
   EXPECT_EQ(while_loop_break_ptr(6), 12);
 }
 
+TEST(statements, for_loop) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "for_loop");
+
+  auto sum = builder.create_function<int32_t(int32_t, int32_t, int32_t)>(
+      "sum", [&](codegen::value<int32_t> begin, codegen::value<int32_t> end, codegen::value<int32_t> step) {
+        auto value = codegen::variable<int32_t>("value", codegen::constant<int32_t>(0));
+        codegen::for_(begin, end, step, [&](codegen::value<int32_t> idx) { value.set(value.get() + idx); });
+        codegen::return_(value.get());
+      });
+
+  auto module = std::move(builder).build();
+
+  auto sum_ptr = module.get_address(sum);
+  EXPECT_EQ(sum_ptr(0, 10, 1), 45);
+  EXPECT_EQ(sum_ptr(1, 10, 3), 12);
+  EXPECT_EQ(sum_ptr(-5, 0, 2), -9);
+  EXPECT_EQ(sum_ptr(10, 0, 1), 0);
+}
+
+TEST(statements, for_loop_continue_break) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "for_loop_continue_break");
+
+  auto fn = builder.create_function<uint64_t(uint64_t)>("for_loop_fn", [&](codegen::value<uint64_t> n) {
+    auto value = codegen::variable<uint64_t>("value", codegen::constant<uint64_t>(0));
+    auto zero = codegen::constant<uint64_t>(0);
+    codegen::for_(zero, n, codegen::constant<uint64_t>(1), [&](codegen::value<uint64_t> idx) {
+      codegen::if_(idx % codegen::constant<uint64_t>(2) == zero, [&] { codegen::continue_(); });
+      codegen::if_(idx == codegen::constant<uint64_t>(7), [&] { codegen::break_(); });
+      value.set(value.get() + idx);
+    });
+    codegen::return_(value.get());
+  });
+
+  auto module = std::move(builder).build();
+
+  auto fn_ptr = module.get_address(fn);
+  EXPECT_EQ(fn_ptr(6), 9);
+  EXPECT_EQ(fn_ptr(100), 9);
+}
+
+TEST(statements, for_loop_hints) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "for_loop_hints");
+
+  auto fill = builder.create_function<void(int32_t*, int64_t)>(
+      "fill", [&](codegen::value<int32_t*> ptr, codegen::value<int64_t> n) {
+        codegen::for_(
+            codegen::constant<int64_t>(0), n, codegen::constant<int64_t>(1),
+            [&](codegen::value<int64_t> idx) { codegen::store(codegen::constant<int32_t>(7), ptr + idx); },
+            codegen::loop_hints{.vectorize = true, .vectorize_width = 8, .interleave_count = 2, .unroll_count = 4});
+        codegen::return_();
+      });
+
+  auto hints = std::vector<std::string>{};
+  for (auto& bb : *builder.module().getFunction("fill")) {
+    if (auto loop_id = bb.getTerminator()->getMetadata(llvm::LLVMContext::MD_loop)) {
+      EXPECT_EQ(loop_id->getOperand(0).get(), loop_id);
+      for (auto i = 1u; i < loop_id->getNumOperands(); i++) {
+        auto hint = llvm::cast<llvm::MDNode>(loop_id->getOperand(i).get());
+        hints.emplace_back(llvm::cast<llvm::MDString>(hint->getOperand(0).get())->getString().str());
+      }
+    }
+  }
+  EXPECT_EQ(hints, (std::vector<std::string>{"llvm.loop.vectorize.enable", "llvm.loop.vectorize.width",
+                                             "llvm.loop.interleave.count", "llvm.loop.unroll.count"}));
+
+  auto module = std::move(builder).build();
+
+  auto values = std::vector<int32_t>(37);
+  module.get_address(fill)(values.data(), values.size());
+  EXPECT_TRUE(std::all_of(values.begin(), values.end(), [](int32_t v) { return v == 7; }));
+}
+
+TEST(statements, branch_hints) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "branch_hints");
+
+  auto classify = builder.create_function<int32_t(int32_t)>("classify", [](codegen::value<int32_t> x) {
+    auto c = [](int32_t v) { return codegen::constant<int32_t>(v); };
+    auto result = codegen::variable<int32_t>("result", c(0));
+    codegen::if_(codegen::unlikely_(x < c(0)), [&] { result.set(c(-1)); });
+    codegen::if_(codegen::likely_(x < c(1000)), [&] { result.set(result.get() + c(1)); });
+    codegen::if_(
+        x > c(100), codegen::cold_([&] { result.set(result.get() + c(100)); }),
+        [&] { result.set(result.get() + c(10)); });
+    auto i = codegen::variable<int32_t>("i", c(0));
+    codegen::while_([&] { return codegen::weighted_(i.get() < x, 7, 3); }, [&] { i.set(i.get() + c(1)); });
+    codegen::return_(result.get() * c(1000) + i.get());
+  });
+
+  auto weights = std::vector<std::pair<uint64_t, uint64_t>>{};
+  for (auto& bb : *builder.module().getFunction("classify")) {
+    auto taken = uint64_t{};
+    auto not_taken = uint64_t{};
+    if (bb.getTerminator()->extractProfMetadata(taken, not_taken)) { weights.emplace_back(taken, not_taken); }
+  }
+  EXPECT_EQ(weights, (std::vector<std::pair<uint64_t, uint64_t>>{{1, 2000}, {2000, 1}, {1, 2000}, {7, 3}}));
+
+  auto module = std::move(builder).build();
+
+  auto classify_ptr = module.get_address(classify);
+  EXPECT_EQ(classify_ptr(-5), 10000);
+  EXPECT_EQ(classify_ptr(10), 11010);
+  EXPECT_EQ(classify_ptr(200), 101200);
+}
+
+TEST(statements, switch_statement) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "switch_statement");
+
+  auto opcode = builder.create_function<int64_t(uint8_t, int64_t, int64_t)>(
+      "opcode", [](codegen::value<uint8_t> op, codegen::value<int64_t> a, codegen::value<int64_t> b) {
+        auto result = codegen::variable<int64_t>("result", codegen::constant<int64_t>(-1));
+        codegen::switch_(
+            op, codegen::case_(uint8_t(0), [&] { result.set(a + b); }, 10),
+            codegen::case_(uint8_t(1), [&] { result.set(a - b); }, 5),
+            codegen::case_(uint8_t(2), [&] { result.set(a * b); }),
+            codegen::case_(uint8_t(3), [&] { codegen::return_(a / b); }), codegen::default_([&] { result.set(b); }, 2));
+        codegen::return_(result.get());
+      });
+
+  auto negative = builder.create_function<int32_t(int32_t)>("negative", [](codegen::value<int32_t> x) {
+    auto result = codegen::variable<int32_t>("result", x);
+    codegen::switch_(x, codegen::case_(-2, [&] { result.set(codegen::constant<int32_t>(20)); }),
+                     codegen::case_(-1, [&] { result.set(codegen::constant<int32_t>(10)); }));
+    codegen::return_(result.get());
+  });
+
+  auto switches = std::vector<std::vector<uint64_t>>{};
+  for (auto& fn : builder.module()) {
+    for (auto& bb : fn) {
+      auto sw = llvm::dyn_cast<llvm::SwitchInst>(bb.getTerminator());
+      if (!sw) { continue; }
+      auto weights = std::vector<uint64_t>{};
+      if (auto prof = sw->getMetadata(llvm::LLVMContext::MD_prof)) {
+        for (auto i = 1u; i < prof->getNumOperands(); i++) {
+          weights.emplace_back(llvm::mdconst::extract<llvm::ConstantInt>(prof->getOperand(i))->getZExtValue());
+        }
+      }
+      switches.emplace_back(std::move(weights));
+    }
+  }
+  EXPECT_EQ(switches, (std::vector<std::vector<uint64_t>>{{2, 10, 5, 1, 1}, {}}));
+
+  auto module = std::move(builder).build();
+
+  auto opcode_ptr = module.get_address(opcode);
+  EXPECT_EQ(opcode_ptr(0, 7, 3), 10);
+  EXPECT_EQ(opcode_ptr(1, 7, 3), 4);
+  EXPECT_EQ(opcode_ptr(2, 7, 3), 21);
+  EXPECT_EQ(opcode_ptr(3, 7, 3), 2);
+  EXPECT_EQ(opcode_ptr(4, 7, 3), 3);
+  EXPECT_EQ(opcode_ptr(255, 7, 3), 3);
+
+  auto negative_ptr = module.get_address(negative);
+  EXPECT_EQ(negative_ptr(-2), 20);
+  EXPECT_EQ(negative_ptr(-1), 10);
+  EXPECT_EQ(negative_ptr(5), 5);
+}
+
+TEST(statements, switch_invalid_cases) {
+  auto comp = codegen::compiler_context{};
+  {
+    auto builder = codegen::module_builder(comp, "switch_duplicate");
+    auto duplicate = [](codegen::value<int32_t> x) {
+      codegen::switch_(x, codegen::case_(1, [] {}), codegen::case_(int64_t(1), [] {}));
+      codegen::return_();
+    };
+    EXPECT_THROW(builder.create_function<void(int32_t)>("duplicate", duplicate), codegen::llvm_error);
+  }
+  {
+    auto builder = codegen::module_builder(comp, "switch_out_of_range");
+    auto out_of_range = [](codegen::value<uint8_t> x) {
+      codegen::switch_(x, codegen::case_(256, [] {}));
+      codegen::return_();
+    };
+    EXPECT_THROW(builder.create_function<void(uint8_t)>("out_of_range", out_of_range), codegen::llvm_error);
+  }
+}
+
+TEST(statements, select) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "select");
+
+  auto min = builder.create_function<uint32_t(uint32_t, uint32_t)>(
+      "min", [](codegen::value<uint32_t> a, codegen::value<uint32_t> b) {
+        codegen::return_(codegen::select_(a < b, a, b));
+      });
+
+  auto clamp = builder.create_function<double(double, double, double)>(
+      "clamp", [](codegen::value<double> x, codegen::value<double> lo, codegen::value<double> hi) {
+        codegen::return_(codegen::select_(x < lo, lo, codegen::select_(x > hi, hi, x)) * codegen::constant<double>(2));
+      });
+
+  // appends every value to the output, but advances the position only for the selected ones.
+  auto filter = builder.create_function<uint64_t(int32_t*, int32_t, int32_t*, uint64_t)>(
+      "filter", [](codegen::value<int32_t*> in, codegen::value<int32_t> threshold, codegen::value<int32_t*> out,
+                   codegen::value<uint64_t> n) {
+        auto selected = codegen::variable<uint64_t>("selected", codegen::constant<uint64_t>(0));
+        codegen::for_(codegen::constant<uint64_t>(0), n, codegen::constant<uint64_t>(1),
+                      [&](codegen::value<uint64_t> i) {
+                        auto v = codegen::load(in + i);
+                        codegen::store(v, out + selected.get());
+                        selected.set(selected.get() + codegen::select_(v > threshold, codegen::constant<uint64_t>(1),
+                                                                       codegen::constant<uint64_t>(0)));
+                      });
+        codegen::return_(selected.get());
+      });
+
+  auto vmax = builder.create_function<void(int16_t*, int16_t*, int16_t*)>(
+      "vmax", [](codegen::value<int16_t*> x, codegen::value<int16_t*> y, codegen::value<int16_t*> out) {
+        auto a = codegen::load<8>(x);
+        auto b = codegen::load<8>(y);
+        codegen::store(codegen::select_(a > b, a, b), out);
+        codegen::return_();
+      });
+
+  auto has_branch = [&](char const* name) {
+    auto& fn = *builder.module().getFunction(name);
+    return std::any_of(fn.begin(), fn.end(), [](llvm::BasicBlock& bb) {
+      auto br = llvm::dyn_cast<llvm::BranchInst>(bb.getTerminator());
+      return br && br->isConditional();
+    });
+  };
+  EXPECT_FALSE(has_branch("min"));
+  EXPECT_FALSE(has_branch("clamp"));
+  EXPECT_FALSE(has_branch("vmax"));
+
+  auto module = std::move(builder).build();
+
+  auto min_ptr = module.get_address(min);
+  EXPECT_EQ(min_ptr(3, 5), 3u);
+  EXPECT_EQ(min_ptr(5, 3), 3u);
+  EXPECT_EQ(min_ptr(7, 7), 7u);
+
+  auto clamp_ptr = module.get_address(clamp);
+  EXPECT_EQ(clamp_ptr(-1, 0, 1), 0);
+  EXPECT_EQ(clamp_ptr(0.25, 0, 1), 0.5);
+  EXPECT_EQ(clamp_ptr(3, 0, 1), 2);
+
+  auto in = std::vector<int32_t>{5, -3, 8, 1, -7, 2, 4, 0};
+  auto out = std::vector<int32_t>(in.size());
+  EXPECT_EQ(module.get_address(filter)(in.data(), 1, out.data(), in.size()), 4u);
+  EXPECT_EQ(std::vector<int32_t>(out.begin(), out.begin() + 4), (std::vector<int32_t>{5, 8, 2, 4}));
+
+  auto x = std::vector<int16_t>{1, -2, 3, -4, 5, -6, 7, -8};
+  auto y = std::vector<int16_t>{-1, 2, -3, 4, -5, 6, -7, 8};
+  auto vout = std::vector<int16_t>(8);
+  module.get_address(vmax)(x.data(), y.data(), vout.data());
+  EXPECT_EQ(vout, (std::vector<int16_t>{1, 2, 3, 4, 5, 6, 7, 8}));
+}
+
 int main(int argc, char** argv) {
   INIT_LLVM_ENV(argc, argv);
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,200 @@
+/*
+ * Copyright © 2019 Paweł Dziepak
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "codegen/codegen.hpp"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <filesystem>
+#include <numeric>
+
+TEST(vector, arithmetic) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "vector_arithmetic");
+
+  auto axpy = builder.create_function<void(int32_t*, int32_t*, int32_t, int32_t*)>(
+      "axpy", [](codegen::value<int32_t*> x, codegen::value<int32_t*> y, codegen::value<int32_t> a,
+                 codegen::value<int32_t*> out) {
+        auto r = codegen::variable<codegen::vec<int32_t, 8>>("r", codegen::splat<8>(a) * codegen::load<8>(x));
+        r.set(r.get() + codegen::load<8>(y));
+        codegen::store(r.get(), out);
+        codegen::return_();
+      });
+
+  auto fdiv = builder.create_function<void(float*, float*, float*)>(
+      "fdiv", [](codegen::value<float*> x, codegen::value<float*> y, codegen::value<float*> out) {
+        codegen::store(codegen::load<4>(x) / codegen::load<4>(y), out);
+        codegen::return_();
+      });
+
+  auto udiv = builder.create_function<void(uint16_t*, uint16_t*, uint16_t*)>(
+      "udiv", [](codegen::value<uint16_t*> x, codegen::value<uint16_t*> y, codegen::value<uint16_t*> out) {
+        codegen::store((codegen::load<8>(x) / codegen::load<8>(y)) ^ codegen::load<8>(x), out);
+        codegen::return_();
+      });
+
+  auto module = std::move(builder).build();
+
+  auto x = std::array<int32_t, 8>{1, -2, 3, -4, 5, -6, 7, -8};
+  auto y = std::array<int32_t, 8>{10, 20, 30, 40, 50, 60, 70, 80};
+  auto out = std::array<int32_t, 8>{};
+  module.get_address(axpy)(x.data(), y.data(), 3, out.data());
+  for (auto i = 0u; i < out.size(); i++) { EXPECT_EQ(out[i], 3 * x[i] + y[i]); }
+
+  auto fx = std::array<float, 4>{1.f, 2.f, 3.f, 4.f};
+  auto fy = std::array<float, 4>{2.f, 4.f, 8.f, 16.f};
+  auto fout = std::array<float, 4>{};
+  module.get_address(fdiv)(fx.data(), fy.data(), fout.data());
+  for (auto i = 0u; i < fout.size(); i++) { EXPECT_EQ(fout[i], fx[i] / fy[i]); }
+
+  auto ux = std::array<uint16_t, 8>{65535, 100, 7, 9, 1000, 50000, 3, 1};
+  auto uy = std::array<uint16_t, 8>{3, 7, 2, 9, 10, 7, 5, 1};
+  auto uout = std::array<uint16_t, 8>{};
+  module.get_address(udiv)(ux.data(), uy.data(), uout.data());
+  for (auto i = 0u; i < uout.size(); i++) { EXPECT_EQ(uout[i], uint16_t((ux[i] / uy[i]) ^ ux[i])); }
+}
+
+TEST(vector, lanes) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "vector_lanes");
+
+  auto reverse = builder.create_function<void(int32_t*, int32_t*)>(
+      "reverse", [](codegen::value<int32_t*> in, codegen::value<int32_t*> out) {
+        auto v = codegen::load<4>(in);
+        auto r = codegen::shuffle(v, {3, 2, 1, 0});
+        codegen::store(codegen::insert(r, 0, codegen::extract(v, 1)), out);
+        codegen::return_();
+      });
+
+  auto interleave = builder.create_function<void(int32_t*, int32_t, int32_t*)>(
+      "interleave", [](codegen::value<int32_t*> in, codegen::value<int32_t> x, codegen::value<int32_t*> out) {
+        auto v = codegen::load<4>(in);
+        codegen::store(codegen::shuffle(v, codegen::splat<4>(x), {0, 4, 1, 5, 2, 6, 3, 7}), out);
+        codegen::return_();
+      });
+
+  auto lane = builder.create_function<int32_t(int32_t*, uint32_t)>(
+      "lane", [](codegen::value<int32_t*> in, codegen::value<uint32_t> idx) {
+        codegen::return_(codegen::extract(codegen::load<4>(in), idx));
+      });
+
+  auto module = std::move(builder).build();
+
+  auto in = std::array<int32_t, 4>{1, 2, 3, 4};
+  auto out = std::array<int32_t, 4>{};
+  module.get_address(reverse)(in.data(), out.data());
+  EXPECT_EQ(out, (std::array<int32_t, 4>{2, 3, 2, 1}));
+
+  auto out8 = std::array<int32_t, 8>{};
+  module.get_address(interleave)(in.data(), 9, out8.data());
+  EXPECT_EQ(out8, (std::array<int32_t, 8>{1, 9, 2, 9, 3, 9, 4, 9}));
+
+  auto lane_ptr = module.get_address(lane);
+  for (auto i = 0u; i < in.size(); i++) { EXPECT_EQ(lane_ptr(in.data(), i), in[i]); }
+}
+
+TEST(vector, reductions) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "vector_reductions");
+
+  auto sum = builder.create_function<int32_t(int32_t*)>(
+      "sum", [](codegen::value<int32_t*> in) { codegen::return_(codegen::reduce_add(codegen::load<8>(in))); });
+  auto min = builder.create_function<int32_t(int32_t*)>(
+      "min", [](codegen::value<int32_t*> in) { codegen::return_(codegen::reduce_min(codegen::load<8>(in))); });
+  auto umax = builder.create_function<uint32_t(uint32_t*)>(
+      "umax", [](codegen::value<uint32_t*> in) { codegen::return_(codegen::reduce_max(codegen::load<8>(in))); });
+  auto bits = builder.create_function<uint32_t(uint32_t*)>(
+      "bits", [](codegen::value<uint32_t*> in) { codegen::return_(codegen::reduce_or(codegen::load<8>(in))); });
+  auto fsum = builder.create_function<double(double*)>(
+      "fsum", [](codegen::value<double*> in) { codegen::return_(codegen::reduce_add(codegen::load<4>(in))); });
+
+  auto module = std::move(builder).build();
+
+  auto in = std::array<int32_t, 8>{5, -3, 8, 1, -7, 2, 4, 0};
+  EXPECT_EQ(module.get_address(sum)(in.data()), std::accumulate(in.begin(), in.end(), 0));
+  EXPECT_EQ(module.get_address(min)(in.data()), -7);
+
+  auto uin = std::array<uint32_t, 8>{1, 2, 4, 0x80000000u, 16, 32, 64, 128};
+  EXPECT_EQ(module.get_address(umax)(uin.data()), 0x80000000u);
+  EXPECT_EQ(module.get_address(bits)(uin.data()), 0x800000ffu);
+
+  auto fin = std::array<double, 4>{0.5, 0.25, 2, 4};
+  EXPECT_EQ(module.get_address(fsum)(fin.data()), 6.75);
+}
+
+TEST(vector, masks) {
+  auto comp = codegen::compiler_context{};
+  auto builder = codegen::module_builder(comp, "vector_masks");
+
+  auto less = builder.create_function<uint8_t(float*, float*)>(
+      "less", [](codegen::value<float*> x, codegen::value<float*> y) {
+        codegen::return_(codegen::to_bitmask(codegen::load<8>(x) < codegen::load<8>(y)));
+      });
+
+  auto any_equal = builder.create_function<bool(int64_t*, int64_t)>(
+      "any_equal", [](codegen::value<int64_t*> x, codegen::value<int64_t> y) {
+        codegen::return_(codegen::any(codegen::load<4>(x) == codegen::splat<4>(y)));
+      });
+
+  auto all_equal = builder.create_function<bool(int64_t*, int64_t)>(
+      "all_equal", [](codegen::value<int64_t*> x, codegen::value<int64_t> y) {
+        codegen::return_(codegen::all(codegen::load<4>(x) == codegen::splat<4>(y)));
+      });
+
+  auto xnor = builder.create_function<uint16_t(uint16_t, uint32_t)>(
+      "xnor", [](codegen::value<uint16_t> a, codegen::value<uint32_t> b) {
+        codegen::return_(codegen::to_bitmask(codegen::from_bitmask<16>(a) == codegen::from_bitmask<16>(b)));
+      });
+
+  auto module = std::move(builder).build();
+
+  auto x = std::array<float, 8>{1, 2, 3, 4, 5, 6, 7, 8};
+  auto y = std::array<float, 8>{2, 2, 4, 3, 6, 5, 8, 7};
+  EXPECT_EQ(module.get_address(less)(x.data(), y.data()), 0b01010101);
+
+  auto values = std::array<int64_t, 4>{3, 3, 3, 4};
+  EXPECT_TRUE(module.get_address(any_equal)(values.data(), 4));
+  EXPECT_FALSE(module.get_address(any_equal)(values.data(), 5));
+  EXPECT_FALSE(module.get_address(all_equal)(values.data(), 3));
+  values[3] = 3;
+  EXPECT_TRUE(module.get_address(all_equal)(values.data(), 3));
+
+  EXPECT_EQ(module.get_address(xnor)(0x1234, 0xffff00ff), 0xed34);
+}
+
+TEST(vector, header_signatures) {
+  auto vectors = codegen::detail::function_builder<void(codegen::vec<float, 8>*)>::signature("vectors");
+  EXPECT_TRUE(vectors.declarable);
+
+  // masks have no c++ spelling, header functions take bitmasks instead, see to_bitmask().
+  auto masks = codegen::detail::function_builder<void(codegen::vec<bool, 8>*)>::signature("masks");
+  EXPECT_FALSE(masks.declarable);
+  auto path = std::filesystem::temp_directory_path() / "cg_vector_header_test.hpp";
+  EXPECT_THROW(codegen::detail::write_header(path, "header_signatures", {vectors, masks}), codegen::llvm_error);
+}
+
+int main(int argc, char** argv) {
+  INIT_LLVM_ENV(argc, argv);
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}